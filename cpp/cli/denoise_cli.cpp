@@ -0,0 +1,407 @@
+// ネイティブのバッチ復元ツール
+// 画像 1 枚ごとに DenoiseEngine を 1 つ作り、ワークスティーリング型スケジューラで並行に処理する
+// (--tile 指定時は画像を順に処理し、タイルを並行に処理する)。
+// 復元結果はファイルに書き出し、画像ごとの指標を JSON 1 行として標準出力へ出す
+//
+//   denoise_cli [options] FILE...
+//     --model gmrf|hgmrf|lc|rtv  モデル (既定: gmrf)
+//     --set KEY=VALUE            パラメータ (Embind と同じフィールド名、複数指定可)
+//     --threads N                同時に処理する画像数 (0: 論理コア数)
+//     --engine-threads N         エンジン 1 つあたりのスレッド数 (既定: 1)
+//     --out-dir DIR              出力先 (既定: 入力と同じディレクトリ)
+//     --ref-dir DIR              同名の原画像を置いたディレクトリ (PSNR/SSIM の基準)
+//     --noise SIGMA              入力を原画像とみなし、ガウス雑音を加えてから復元する
+//     --seed N                   --noise の乱数の種 (画像と行ごとに stream を変える)
+//     --tile N                   N x N のタイルに分けて解く (巨大な画像向け、0: 全画面で解く)。
+//                                画像は 1 枚ずつ行の帯単位で読み書きし、--threads はタイルの並列数になる
+//     --halo N                   タイルの重なりの幅 (既定: 32)。is_learning のときは中央の窓で
+//                                一度だけ学習し、全タイルをその値で学習なしに解く
+//     --raw WxH                  拡張子 .raw のヘッダなし 8 bit 画像のサイズ
+//
+// 入出力はメモリマップで行い、8 bit グレースケールの入力はファイル上の画素をエンジンが直接読む
+#include "../engine/denoise_engine.hpp"
+#include "../engine/tiled_runner.hpp"
+#include "../io/image_io.hpp"
+#include "../utils/rng.hpp"
+#include "../utils/task_scheduler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Options {
+    std::string model = "gmrf";
+    std::vector<std::pair<std::string, std::string>> params;
+    int threads = 0;
+    int engine_threads = 1;
+    std::string out_dir, ref_dir;
+    double noise_sigma = 0.0;
+    uint64_t seed = 1;
+    int tile = 0, halo = 32;
+    io::RawSize raw;
+    std::vector<std::string> files;
+};
+
+// パラメータ構造体のフィールド表 (名前と型付きポインタ)
+struct Field {
+    const char* name;
+    double* d = nullptr;
+    int* i = nullptr;
+    bool* b = nullptr;
+};
+
+std::vector<Field> fields_of(GMRFParams& p) {
+    return {{"lambda", &p.lambda}, {"alpha", &p.alpha}, {"sigma_sq", &p.sigma_sq}, {"max_iter", nullptr, &p.max_iter},
+            {"is_learning", nullptr, nullptr, &p.is_learning}, {"eta_lambda", &p.eta_lambda}, {"eta_alpha", &p.eta_alpha},
+            {"solver", nullptr, &p.solver}, {"precision", nullptr, &p.precision}};
+}
+
+std::vector<Field> fields_of(HGMRFParams& p) {
+    return {{"lambda", &p.lambda}, {"alpha", &p.alpha}, {"sigma_sq", &p.sigma_sq}, {"gamma_sq", &p.gamma_sq},
+            {"max_iter", nullptr, &p.max_iter}, {"is_learning", nullptr, nullptr, &p.is_learning},
+            {"eta_lambda", &p.eta_lambda}, {"eta_alpha", &p.eta_alpha}, {"eta_gamma2", &p.eta_gamma2},
+            {"verify_likelihood", nullptr, nullptr, &p.verify_likelihood}, {"solver", nullptr, &p.solver}};
+}
+
+std::vector<Field> fields_of(LCMRFParams& p) {
+    return {{"lambda", &p.lambda}, {"alpha", &p.alpha}, {"sigma_sq", &p.sigma_sq}, {"s", &p.s},
+            {"max_iter", nullptr, &p.max_iter}, {"is_learning", nullptr, nullptr, &p.is_learning},
+            {"epsilon_map", &p.epsilon_map}, {"map_optimizer", nullptr, &p.map_optimizer},
+            {"epsilon_pri", &p.epsilon_pri}, {"epsilon_post", &p.epsilon_post}, {"eta_lambda", &p.eta_lambda},
+            {"eta_alpha", &p.eta_alpha}, {"eta_sigma2", &p.eta_sigma2}, {"n_pri", nullptr, &p.n_pri},
+            {"n_post", nullptr, &p.n_post}, {"t_hat_max", nullptr, &p.t_hat_max}, {"t_dot_max", nullptr, &p.t_dot_max},
+            {"persistent_chains", nullptr, nullptr, &p.persistent_chains}, {"seed", nullptr, &p.seed},
+            {"precision", nullptr, &p.precision}};
+}
+
+std::vector<Field> fields_of(RTVMRFParams& p) {
+    return {{"lambda", &p.lambda}, {"alpha", &p.alpha}, {"sigma_sq", &p.sigma_sq}, {"max_iter", nullptr, &p.max_iter},
+            {"is_learning", nullptr, nullptr, &p.is_learning}, {"solver", nullptr, &p.solver},
+            {"tv_solver", nullptr, &p.tv_solver}};
+}
+
+template <class Params>
+Params parse_params(const Options& opt) {
+    Params p;
+    std::vector<Field> fields = fields_of(p);
+    for (const auto& kv : opt.params) {
+        auto it = std::find_if(fields.begin(), fields.end(), [&](const Field& f) { return kv.first == f.name; });
+        if (it == fields.end()) throw std::runtime_error("unknown parameter '" + kv.first + "' for model " + opt.model);
+        const std::string& v = kv.second;
+        size_t used = 0;
+        try {
+            if (it->d) *it->d = std::stod(v, &used);
+            else if (it->i) *it->i = std::stoi(v, &used);
+            else if (v == "true" || v == "1") { *it->b = true; used = v.size(); }
+            else if (v == "false" || v == "0") { *it->b = false; used = v.size(); }
+        } catch (const std::exception&) {
+            used = 0;
+        }
+        if (used != v.size() || v.empty()) throw std::runtime_error("invalid value '" + v + "' for parameter " + kv.first);
+    }
+    return p;
+}
+
+std::string base_name(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+std::string output_path(const Options& opt, const std::string& input) {
+    std::string name = base_name(input);
+    std::string dir = opt.out_dir.empty() ? input.substr(0, input.size() - name.size()) : opt.out_dir + "/";
+    size_t dot = name.find_last_of('.');
+    std::string stem = dot == std::string::npos ? name : name.substr(0, dot);
+    std::string ext = dot == std::string::npos ? ".pgm" : name.substr(dot);
+    return dir + stem + "_" + opt.model + ext;
+}
+
+std::string json_string(const std::string& s) {
+    std::string out = "\"";
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') { out += '\\'; out += static_cast<char>(c); }
+        else if (c == '\n') out += "\\n";
+        else if (c < 0x20) { char buf[8]; std::snprintf(buf, sizeof(buf), "\\u%04x", c); out += buf; }
+        else out += static_cast<char>(c);
+    }
+    return out + "\"";
+}
+
+std::string json_number(double v) {
+    if (!std::isfinite(v)) return "null";
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.6g", v);
+    return buf;
+}
+
+// 原画像の行にガウス雑音を加え、フロントエンドと同じく丸めて [0, 255] に収める。
+// 乱数の stream を (画像番号, 行) ごとに変えるので、タイル実行でも全画面と同じ雑音画像になる
+void add_noise_rows(const Options& opt, int index, int y0, int count, int width, const uint8_t* clean, uint8_t* noisy) {
+    std::vector<double> z(width);
+    for (int y = 0; y < count; ++y) {
+        utils::Philox rng(opt.seed, (static_cast<uint64_t>(index) << 32) | static_cast<uint32_t>(y0 + y));
+        rng.fill_normal(z.data(), width);
+        size_t row = static_cast<size_t>(y) * width;
+        for (int x = 0; x < width; ++x) {
+            double v = std::round(clean[row + x] + opt.noise_sigma * z[x]);
+            noisy[row + x] = static_cast<uint8_t>(std::min(255.0, std::max(0.0, v)));
+        }
+    }
+}
+
+// 入力画像 (と原画像) を行単位で読む。--ref-dir なら同名の原画像を、--noise なら入力を原画像として雑音を加える
+class Source {
+public:
+    Source(const Options& opt_in, const std::string& path, int index_in) : opt(opt_in), input(path, opt.raw), index(index_in) {
+        if (!opt.ref_dir.empty()) {
+            reference = std::make_unique<io::ImageReader>(opt.ref_dir + "/" + base_name(path), opt.raw);
+            if (reference->width() != input.width() || reference->height() != input.height()) {
+                throw std::runtime_error("reference size does not match " + path);
+            }
+        }
+    }
+    int width() const { return input.width(); }
+    int height() const { return input.height(); }
+    bool has_original() const { return reference || opt.noise_sigma > 0; }
+
+    // 雑音を合成せず、入力 (と原画像) がファイル上の画素をそのまま指せるならゼロコピーのビューを返す
+    bool views(utils::ImageView& noisy, utils::ImageView& original) const {
+        if (opt.noise_sigma > 0 || !input.view(noisy)) return false;
+        if (!reference) { original = noisy; return true; }
+        return reference->view(original);
+    }
+
+    void read_rows(int y0, int count, uint8_t* noisy, uint8_t* original) {
+        if (reference) {
+            input.read_rows(y0, count, noisy);
+            if (original) reference->read_rows(y0, count, original);
+        } else if (opt.noise_sigma > 0) {
+            clean.resize(static_cast<size_t>(count) * width());
+            input.read_rows(y0, count, clean.data());
+            add_noise_rows(opt, index, y0, count, width(), clean.data(), noisy);
+            if (original) std::copy(clean.begin(), clean.end(), original);
+        } else {
+            input.read_rows(y0, count, noisy);
+        }
+    }
+
+private:
+    const Options& opt;
+    io::ImageReader input;
+    std::unique_ptr<io::ImageReader> reference;
+    int index;
+    std::vector<uint8_t> clean;
+};
+
+void solve(const Options& opt, DenoiseEngine& engine, const std::function<void(const IterationResult&)>& on_step) {
+    if (opt.model == "gmrf") engine.gmrf(parse_params<GMRFParams>(opt), on_step);
+    else if (opt.model == "hgmrf") engine.hgmrf(parse_params<HGMRFParams>(opt), on_step);
+    else if (opt.model == "lc") engine.lc_mrf(parse_params<LCMRFParams>(opt), on_step);
+    else engine.rtv_mrf(parse_params<RTVMRFParams>(opt), on_step);
+}
+
+bool is_learning(const Options& opt) {
+    if (opt.model == "gmrf") return parse_params<GMRFParams>(opt).is_learning;
+    if (opt.model == "hgmrf") return parse_params<HGMRFParams>(opt).is_learning;
+    if (opt.model == "lc") return parse_params<LCMRFParams>(opt).is_learning;
+    return parse_params<RTVMRFParams>(opt).is_learning;
+}
+
+// 学習した値で上書きし、学習なしにした設定 (--set より後に置くので優先される)
+Options with_learned(const Options& opt, const LearnedParams& lp) {
+    Options out = opt;
+    auto set = [&](const char* key, double v) {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.17g", v);
+        out.params.emplace_back(key, buf);
+    };
+    out.params.emplace_back("is_learning", "0");
+    set("lambda", lp.lambda); set("alpha", lp.alpha); set("sigma_sq", lp.sigma_sq);
+    if (opt.model == "hgmrf") set("gamma_sq", lp.gamma_sq);
+    return out;
+}
+
+// 画像 1 枚を復元し、指標の JSON 行を返す。tiled_pool を渡すとタイル実行にする
+std::string process(const Options& opt, const std::string& input, int index, utils::TaskScheduler* tiled_pool) {
+    auto t0 = std::chrono::steady_clock::now();
+    Source source(opt, input, index);
+    int width = source.width(), height = source.height();
+    bool has_original = source.has_original();
+    std::string out = output_path(opt, input);
+    io::ImageWriter writer(out, width, height);
+
+    int iterations = 0, tiles = 0;
+    double psnr = 0, ssim = 0;
+    utils::ImageView noisy_view, original_view;
+    bool zero_copy = source.views(noisy_view, original_view);
+    if (tiled_pool) {
+        TileConfig cfg;
+        cfg.tile = opt.tile; cfg.halo = opt.halo;
+        TileReadRows read_rows = [&](int y0, int count, uint8_t* noisy, uint8_t* original) {
+            if (!zero_copy) { source.read_rows(y0, count, noisy, original); return; }
+            for (int y = 0; y < count; ++y) {
+                std::copy_n(noisy_view.row(y0 + y), width, noisy + static_cast<size_t>(y) * width);
+                if (original) std::copy_n(original_view.row(y0 + y), width, original + static_cast<size_t>(y) * width);
+            }
+        };
+        // タイルごとに学習すると隣り合うコア領域が異なるパラメータで復元されて継ぎ目が出るので、
+        // 中央の窓で一度だけ学習し、全タイルをその値の学習なしで解く
+        Options tile_opt = opt;
+        if (is_learning(opt)) {
+            LearnedParams lp = learn_tile_params(width, height, cfg, has_original, read_rows,
+                [&](DenoiseEngine& engine) { solve(opt, engine, [&](const IterationResult& res) { iterations = res.iteration; }); });
+            tile_opt = with_learned(opt, lp);
+        }
+        std::mutex iter_mtx;
+        TileSolve solve_tile = [&](DenoiseEngine& engine) {
+            int last = 0;
+            solve(tile_opt, engine, [&](const IterationResult& res) { last = res.iteration; });
+            std::lock_guard<std::mutex> lock(iter_mtx);
+            iterations = std::max(iterations, last);
+        };
+        TiledResult r = zero_copy
+            ? run_tiled(noisy_view, has_original ? &original_view : nullptr, writer.view(), cfg, solve_tile, *tiled_pool)
+            : run_tiled(width, height, cfg, has_original, read_rows,
+                  [&](int y0, int count, const uint8_t* rows) { writer.write_rows(y0, count, rows); },
+                  solve_tile, *tiled_pool);
+        tiles = r.tiles; psnr = r.psnr; ssim = r.ssim;
+    } else {
+        std::vector<uint8_t> noisy, original;
+        if (!zero_copy) {
+            // 変換が必要な形式 (カラーの BMP など) と雑音の合成はいったん 8 bit の画素列に読む
+            size_t n = static_cast<size_t>(width) * height;
+            noisy.resize(n);
+            original.resize(has_original ? n : 0);
+            source.read_rows(0, height, noisy.data(), has_original ? original.data() : nullptr);
+            noisy_view = utils::contiguous_view(static_cast<const uint8_t*>(noisy.data()), width, height);
+            original_view = has_original ? utils::contiguous_view(static_cast<const uint8_t*>(original.data()), width, height) : noisy_view;
+        }
+
+        DenoiseEngine engine(width, height);
+        engine.set_num_threads(opt.engine_threads);
+        ProgressPolicy policy;
+        policy.every_k = 1 << 30; // 途中経過は不要 (開始と終了の強制報告だけ受け取る)
+        policy.compute_metrics = false;
+        engine.set_progress_policy(policy);
+        engine.set_input(original_view, noisy_view);
+
+        IterationResult last{};
+        solve(opt, engine, [&](const IterationResult& res) { last = res; });
+        engine.get_output(writer.view()); // 出力ファイルのマップへ直接書く
+        iterations = last.iteration; psnr = last.psnr; ssim = last.ssim;
+    }
+    writer.close();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::ostringstream line;
+    line << "{\"file\":" << json_string(input) << ",\"output\":" << json_string(out)
+         << ",\"model\":" << json_string(opt.model) << ",\"width\":" << width << ",\"height\":" << height
+         << ",\"iterations\":" << iterations;
+    if (tiled_pool) line << ",\"tiles\":" << tiles;
+    line << ",\"psnr\":" << (has_original ? json_number(psnr) : "null")
+         << ",\"ssim\":" << (has_original ? json_number(ssim) : "null")
+         << ",\"seconds\":" << json_number(seconds) << ",\"status\":\"ok\"}";
+    return line.str();
+}
+
+void usage() {
+    std::cerr << "usage: denoise_cli [--model gmrf|hgmrf|lc|rtv] [--set key=value]... [--threads N]\n"
+                 "                   [--engine-threads N] [--out-dir DIR] [--ref-dir DIR] [--noise SIGMA]\n"
+                 "                   [--seed N] [--tile N [--halo N]] [--raw WxH] FILE...\n";
+}
+
+Options parse_args(int argc, char** argv) {
+    Options opt;
+    for (int k = 1; k < argc; ++k) {
+        std::string a = argv[k];
+        auto value = [&]() -> std::string {
+            if (k + 1 >= argc) throw std::runtime_error("missing value for " + a);
+            return argv[++k];
+        };
+        if (a == "--model") opt.model = value();
+        else if (a == "--set") {
+            std::string kv = value();
+            size_t eq = kv.find('=');
+            if (eq == std::string::npos) throw std::runtime_error("--set expects key=value, got '" + kv + "'");
+            opt.params.emplace_back(kv.substr(0, eq), kv.substr(eq + 1));
+        }
+        else if (a == "--threads") opt.threads = std::stoi(value());
+        else if (a == "--engine-threads") opt.engine_threads = std::stoi(value());
+        else if (a == "--out-dir") opt.out_dir = value();
+        else if (a == "--ref-dir") opt.ref_dir = value();
+        else if (a == "--noise") opt.noise_sigma = std::stod(value());
+        else if (a == "--seed") opt.seed = std::stoull(value());
+        else if (a == "--tile") opt.tile = std::stoi(value());
+        else if (a == "--halo") opt.halo = std::stoi(value());
+        else if (a == "--raw") {
+            std::string size = value();
+            if (std::sscanf(size.c_str(), "%dx%d", &opt.raw.width, &opt.raw.height) != 2) {
+                throw std::runtime_error("--raw expects WIDTHxHEIGHT, got '" + size + "'");
+            }
+        }
+        else if (a == "--help" || a == "-h") { usage(); std::exit(0); }
+        else if (a.size() > 1 && a[0] == '-') throw std::runtime_error("unknown option " + a);
+        else opt.files.push_back(a);
+    }
+    if (opt.model != "gmrf" && opt.model != "hgmrf" && opt.model != "lc" && opt.model != "rtv") {
+        throw std::runtime_error("unknown model " + opt.model);
+    }
+    if (opt.files.empty()) throw std::runtime_error("no input files");
+    return opt;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    try {
+        opt = parse_args(argc, argv);
+        // パラメータの誤りは画像ごとではなく起動時に報告する
+        if (opt.model == "gmrf") parse_params<GMRFParams>(opt);
+        else if (opt.model == "hgmrf") parse_params<HGMRFParams>(opt);
+        else if (opt.model == "lc") parse_params<LCMRFParams>(opt);
+        else parse_params<RTVMRFParams>(opt);
+    } catch (const std::exception& e) {
+        std::cerr << "denoise_cli: " << e.what() << "\n";
+        usage();
+        return 2;
+    }
+
+    std::mutex out_mtx;
+    int failures = 0;
+    auto run_one = [&](int k, utils::TaskScheduler* tiled_pool) {
+        const std::string& file = opt.files[k];
+        std::string line;
+        bool ok = true;
+        try {
+            line = process(opt, file, k, tiled_pool);
+        } catch (const std::exception& e) {
+            ok = false;
+            line = "{\"file\":" + json_string(file) + ",\"status\":\"error\",\"message\":" + json_string(e.what()) + "}";
+        }
+        std::lock_guard<std::mutex> lock(out_mtx);
+        if (!ok) ++failures;
+        std::cout << line << "\n" << std::flush;
+    };
+    {
+        utils::TaskScheduler scheduler(opt.threads);
+        if (opt.tile > 0) {
+            // タイル実行では画像を 1 枚ずつ処理し、スケジューラにはタイルを流す
+            for (int k = 0; k < static_cast<int>(opt.files.size()); ++k) run_one(k, &scheduler);
+        } else {
+            for (int k = 0; k < static_cast<int>(opt.files.size()); ++k) scheduler.submit([&, k] { run_one(k, nullptr); });
+            scheduler.wait();
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
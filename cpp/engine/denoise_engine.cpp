@@ -1,28 +1,79 @@
 #include "denoise_engine.hpp"
+#include "solver.hpp"
 #include "../utils/core.hpp"
 #include "../utils/numeric_guard.hpp"
+#include "../utils/metrics.hpp"
+#include "../utils/triple_buffer.hpp"
 #include <cmath>
 #include <vector>
 #include <numeric>
 #include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include <thread>
 
-namespace utils {
-    double calculate_psnr(const std::vector<double>& orig, const std::vector<double>& denoise);
-    double calculate_ssim(const std::vector<double>& img1, const std::vector<double>& img2);
-    void generate_ssim_heatmap(const std::vector<double>& orig, const std::vector<double>& denoise, int width, int height, std::vector<uint8_t>& out_rgba);
-}
+// 非同期評価に渡す 1 報告分のスナップショット (中心化を解除した推定値)
+struct MetricsSnapshot {
+    std::vector<double> x;
+    int iter = 0;
+    double energy = 0.0;
+    std::string task;
+    const std::function<void(const IterationResult&)>* on_step = nullptr;
+};
+
+struct DenoiseEngine::AsyncMetrics {
+    utils::TripleBuffer<MetricsSnapshot> buffer;
+    std::mutex mtx;
+    std::condition_variable cv_work, cv_idle;
+    bool stopping = false, busy = false;
+    std::vector<uint8_t> heatmap;
+#if DENOISE_HAS_THREADS
+    std::thread worker;
+#endif
+};
 
 DenoiseEngine::DenoiseEngine(int width, int height) : w(width), h(height), n(width * height) {
     original_data.resize(n);
     noisy_data.resize(n);
     current_data.resize(n);
+    quality.set_reference(original_data);
+}
+
+DenoiseEngine::~DenoiseEngine() {
+    cancel();
+#if DENOISE_HAS_THREADS
+    if (async_metrics) {
+        {
+            std::lock_guard<std::mutex> lock(async_metrics->mtx);
+            async_metrics->stopping = true;
+        }
+        async_metrics->cv_work.notify_one();
+        async_metrics->worker.join();
+    }
+#endif
 }
 
 void DenoiseEngine::set_input(const uint8_t* original_arr, const uint8_t* noisy_arr, int size) {
-    for (int i = 0; i < n; ++i) {
-        original_data[i] = static_cast<double>(original_arr[i]);
-        noisy_data[i] = static_cast<double>(noisy_arr[i]);
+    if (size != n) throw std::invalid_argument("set_input: buffer size does not match the engine");
+    set_input(utils::contiguous_view(original_arr, w, h), utils::contiguous_view(noisy_arr, w, h));
+}
+
+void DenoiseEngine::set_input(const utils::ImageView& original, const utils::ImageView& noisy) {
+    if (original.width != w || original.height != h || noisy.width != w || noisy.height != h) {
+        throw std::invalid_argument("set_input: view size does not match the engine");
+    }
+    for (int y = 0; y < h; ++y) {
+        const uint8_t* a = original.row(y);
+        const uint8_t* b = noisy.row(y);
+        double* oa = &original_data[get_idx(0, y)];
+        double* ob = &noisy_data[get_idx(0, y)];
+        for (int x = 0; x < w; ++x) {
+            oa[x] = static_cast<double>(a[x]);
+            ob[x] = static_cast<double>(b[x]);
+        }
     }
+    quality.set_reference(original_data);
 }
 
 double DenoiseEngine::prepare_work_data(std::vector<double>& centered_noisy) {
@@ -37,37 +88,169 @@ double DenoiseEngine::prepare_work_data(std::vector<double>& centered_noisy) {
     return y_ave;
 }
 
-void DenoiseEngine::report_progress(int iter, double energy, const std::vector<double>& centered_x, double y_ave, const std::string& task, std::function<void(const IterationResult&)> on_step) {
+const std::vector<double>& DenoiseEngine::eigenvalues() {
+    if (phi_cache.empty()) {
+        phi_cache.resize(n);
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                phi_cache[get_idx(x, y)] = 4.0 * pow(sin(M_PI * x / (2.0 * w)), 2.0) + 4.0 * pow(sin(M_PI * y / (2.0 * h)), 2.0);
+            }
+        }
+    }
+    return phi_cache;
+}
+
+const utils::Spectrum* DenoiseEngine::spectrum() {
+    if (!spectrum_checked) {
+        spectrum_cache = utils::Spectrum::get(w, h);
+        spectrum_checked = true;
+    }
+    return spectrum_cache.get();
+}
+
+utils::DCT2D& DenoiseEngine::dct() {
+    if (!dct_plan) dct_plan = std::make_unique<utils::DCT2D>(w, h);
+    return *dct_plan;
+}
+
+utils::Multigrid& DenoiseEngine::multigrid() {
+    if (!mg_plan) mg_plan = std::make_unique<utils::Multigrid>(w, h);
+    return *mg_plan;
+}
+
+void DenoiseEngine::set_num_threads(int threads) {
+    if (threads == num_threads) return;
+    num_threads = threads;
+    thread_pool.reset();
+}
+
+void DenoiseEngine::set_ssim_gaussian(bool gaussian) {
+    ssim_gaussian = gaussian;
+}
+
+utils::ThreadPool& DenoiseEngine::pool() {
+    if (!thread_pool) thread_pool = std::make_unique<utils::ThreadPool>(num_threads);
+    return *thread_pool;
+}
+
+void DenoiseEngine::set_progress_policy(const ProgressPolicy& policy) {
+    progress = policy;
+}
+
+void DenoiseEngine::report_progress(int iter, double energy, const std::vector<double>& centered_x, double y_ave, const std::string& task, const std::function<void(const IterationResult&)>& on_step, bool force) {
+    // 間引き: k 反復ごと、かつ前回の報告から t ミリ秒以上経過したときだけ報告する
+    auto now = std::chrono::steady_clock::now();
+    if (!force) {
+        if (progress.every_k > 1 && iter % progress.every_k != 0) return;
+        if (progress.every_ms > 0 && std::chrono::duration<double, std::milli>(now - last_report).count() < progress.every_ms) return;
+    }
+    last_report = now;
+
+#if DENOISE_HAS_THREADS
+    if (progress.async_metrics && !force) {
+        // スナップショットを置いてすぐに戻る (評価とコールバックは指標スレッドが行う)。
+        // get_output 用に current_data も更新する (get_output はソルバを進めるスレッドから呼ぶので指標スレッドとは競合しない)
+        AsyncMetrics& am = async();
+        MetricsSnapshot& snap = am.buffer.back();
+        for (int i = 0; i < n; ++i) current_data[i] = centered_x[i] + y_ave;
+        snap.x = current_data;
+        snap.iter = iter; snap.energy = energy; snap.task = task; snap.on_step = &on_step;
+        am.buffer.publish();
+        { std::lock_guard<std::mutex> lock(am.mtx); }
+        am.cv_work.notify_one();
+        return;
+    }
+    // 強制報告はそれ以前の報告をすべて届けてから行う (コールバックの順序を保つ)
+    if (async_metrics) drain_async_metrics();
+#endif
+
     // 【重要修正】SSIMは輝度の絶対値(0-255)に依存するため、必ず中心化を解除してから評価する
-    std::vector<double> uncentered(n);
+    // 現在の状態をエンジンに同期（出力用）。中心化の解除は current_data に直接書き込む
     for (int i = 0; i < n; ++i) {
-        uncentered[i] = centered_x[i] + y_ave;
+        current_data[i] = centered_x[i] + y_ave;
     }
     
-    // 評価対象は常に 0-255 の物理的な画素値空間
-    double psnr = utils::calculate_psnr(original_data, uncentered);
-    double ssim = utils::calculate_ssim(original_data, uncentered);
-    
-    // 現在の状態をエンジンに同期（出力用）
-    current_data = uncentered;
-    
-    on_step({iter, energy, psnr, ssim, task});
+    // 評価対象は常に 0-255 の物理的な画素値空間 (指標を省略する設定では強制報告時のみ計算)
+    deliver_progress(current_data, iter, energy, task, on_step, progress.compute_metrics || force, progress_heatmap, &pool());
+}
+
+void DenoiseEngine::deliver_progress(const std::vector<double>& x, int iter, double energy, const std::string& task, const std::function<void(const IterationResult&)>& on_step, bool metrics, std::vector<uint8_t>& heatmap_buf, utils::ThreadPool* heatmap_pool) {
+    double psnr = 0.0, ssim = 0.0;
+    if (metrics) quality.evaluate(x, psnr, ssim);
+    const uint8_t* heatmap = nullptr;
+    if (progress.compute_heatmap) {
+        utils::generate_ssim_heatmap(original_data, x, w, h, heatmap_buf, ssim_gaussian, heatmap_pool);
+        heatmap = heatmap_buf.data();
+    }
+    on_step({iter, energy, psnr, ssim, task, heatmap});
+}
+
+DenoiseEngine::AsyncMetrics& DenoiseEngine::async() {
+    if (!async_metrics) {
+        async_metrics = std::make_unique<AsyncMetrics>();
+#if DENOISE_HAS_THREADS
+        async_metrics->worker = std::thread(&DenoiseEngine::metrics_loop, this);
+#endif
+    }
+    return *async_metrics;
+}
+
+void DenoiseEngine::drain_async_metrics() {
+    AsyncMetrics& am = *async_metrics;
+    std::unique_lock<std::mutex> lock(am.mtx);
+    am.cv_idle.wait(lock, [&] { return !am.busy && !am.buffer.has_new(); });
+}
+
+void DenoiseEngine::metrics_loop() {
+    AsyncMetrics& am = *async_metrics;
+    std::unique_lock<std::mutex> lock(am.mtx);
+    while (true) {
+        am.cv_work.wait(lock, [&] { return am.stopping || am.buffer.has_new(); });
+        if (am.buffer.acquire()) {
+            am.busy = true;
+            lock.unlock();
+            const MetricsSnapshot& snap = am.buffer.front();
+            deliver_progress(snap.x, snap.iter, snap.energy, snap.task, *snap.on_step, progress.compute_metrics, am.heatmap, nullptr);
+            lock.lock();
+            am.busy = false;
+            am.cv_idle.notify_all();
+            continue;
+        }
+        if (am.stopping) return;
+    }
+}
+
+StepStatus DenoiseEngine::step(double budget_ms) {
+    if (!active_solver) return STEP_DONE;
+    StepStatus status = active_solver->step(budget_ms);
+    if (status == STEP_DONE) cancel();
+    return status;
+}
+
+void DenoiseEngine::cancel() {
+    if (!active_solver) return;
+    // 非同期評価のスナップショットはソルバのコールバックを参照するので、破棄する前に届け終える
+    if (async_metrics) drain_async_metrics();
+    active_solver.reset();
 }
 
 void DenoiseEngine::get_output(uint8_t* out_data) {
-    for (int i = 0; i < n; ++i) {
-        out_data[i] = utils::clamp_and_round(current_data[i]);
+    get_output(utils::contiguous_view(out_data, w, h));
+}
+
+void DenoiseEngine::get_output(const utils::MutableImageView& out) {
+    if (out.width != w || out.height != h) throw std::invalid_argument("get_output: view size does not match the engine");
+    for (int y = 0; y < h; ++y) {
+        uint8_t* row = out.row(y);
+        const double* x = &current_data[get_idx(0, y)];
+        for (int i = 0; i < w; ++i) row[i] = utils::clamp_and_round(x[i]);
     }
 }
 
 void DenoiseEngine::get_initial_ssim_heatmap(uint8_t* out_rgba) {
-    std::vector<uint8_t> temp_rgba;
-    utils::generate_ssim_heatmap(original_data, noisy_data, w, h, temp_rgba);
-    std::copy(temp_rgba.begin(), temp_rgba.end(), out_rgba);
+    utils::generate_ssim_heatmap(original_data, noisy_data, w, h, out_rgba, ssim_gaussian, &pool());
 }
 
 void DenoiseEngine::get_ssim_heatmap(uint8_t* out_rgba) {
-    std::vector<uint8_t> temp_rgba;
-    utils::generate_ssim_heatmap(original_data, current_data, w, h, temp_rgba);
-    std::copy(temp_rgba.begin(), temp_rgba.end(), out_rgba);
+    utils::generate_ssim_heatmap(original_data, current_data, w, h, out_rgba, ssim_gaussian, &pool());
 }
@@ -5,7 +5,15 @@
 #include <string>
 #include <functional>
 #include <cstdint>
+#include <memory>
+#include <chrono>
 #include "../utils/core.hpp"
+#include "../utils/dct.hpp"
+#include "../utils/multigrid.hpp"
+#include "../utils/spectrum.hpp"
+#include "../utils/thread_pool.hpp"
+#include "../utils/metrics.hpp"
+#include "../utils/image_view.hpp"
 
 struct IterationResult {
     int iteration;
@@ -13,6 +21,39 @@ struct IterationResult {
     double psnr;
     double ssim;
     std::string current_task;
+    const uint8_t* heatmap = nullptr; // compute_heatmap 指定時の SSIM ヒートマップ (RGBA, コールバック中のみ有効)
+};
+
+// MAP 推定に用いる線形ソルバ (Embind からは整数で受け渡す)
+enum SolverMode : int {
+    SOLVER_GAUSS_SEIDEL = 0, // 辞書式ガウス・ザイデル法 (論文の既定)
+    SOLVER_SPECTRAL = 1,     // DCT 対角化による厳密解 (Neumann 境界)
+    SOLVER_MULTIGRID = 2,    // V サイクル前処理付き CG (サイズ非依存の収束)
+    SOLVER_RED_BLACK = 3     // 赤黒順序のガウス・ザイデル法 (行バンドをスレッド並列化)
+};
+
+// LC-MRF の MAP 推定に用いる最適化法
+enum MapOptimizer : int {
+    MAP_GRADIENT_DESCENT = 0, // 固定ステップ ε_map の勾配降下法 (論文の既定)
+    MAP_NESTEROV = 1          // バックトラッキング付き Nesterov 加速勾配法 (ε_map は初期ステップ)
+};
+
+// rTV-MRF の最適化法
+enum TVSolver : int {
+    TV_SPLIT_BREGMAN = 0, // split-Bregman (x-step は solver で選ぶ)
+    TV_PRIMAL_DUAL = 1    // Chambolle-Pock 主双対法 (全画素独立のステンシルのみで構成、行バンド並列)
+};
+
+// 作業領域の精度 (Embind からは整数で受け渡す)
+enum Precision : int {
+    PRECISION_DOUBLE = 0, // すべて double (既定)
+    PRECISION_MIXED = 1   // スイープとサンプリングの作業領域は float、総和・尤度・パラメータ更新は double
+};
+
+// 再開可能な実行の状態 (Embind からは整数で受け渡す)
+enum StepStatus : int {
+    STEP_RUNNING = 0, // まだ反復が残っている
+    STEP_DONE = 1     // 終了した (最後の報告まで済んでいる)
 };
 
 struct GMRFParams {
@@ -23,6 +64,8 @@ struct GMRFParams {
     bool is_learning = true;
     double eta_lambda = 1.0e-12;
     double eta_alpha = 5.0e-7;
+    int solver = SOLVER_GAUSS_SEIDEL;
+    int precision = PRECISION_DOUBLE;
 };
 
 struct HGMRFParams {
@@ -36,6 +79,7 @@ struct HGMRFParams {
     double eta_alpha = 5.0e-8;
     double eta_gamma2 = 5.0e-8;
     bool verify_likelihood = false;
+    int solver = SOLVER_GAUSS_SEIDEL;
 };
 
 struct LCMRFParams {
@@ -46,6 +90,7 @@ struct LCMRFParams {
     int max_iter = 50;
     bool is_learning = true;
     double epsilon_map = 1.0;
+    int map_optimizer = MAP_GRADIENT_DESCENT;
     double epsilon_pri = 1.0e-4;
     double epsilon_post = 1.0e-4;
     double eta_lambda = 1.0e-14;
@@ -55,6 +100,9 @@ struct LCMRFParams {
     int n_post = 5;
     int t_hat_max = 10;
     int t_dot_max = 10;
+    bool persistent_chains = false; // サンプリング連鎖を反復間で持ち越す (false: 論文どおり毎反復で初期化)
+    int seed = 1;                   // 連鎖ごとの乱数列の種
+    int precision = PRECISION_DOUBLE; // MIXED: MALA 連鎖を float で保持する (MAP 推定は double のまま)
 };
 
 struct RTVMRFParams {
@@ -63,30 +111,109 @@ struct RTVMRFParams {
     double sigma_sq = 100.0;
     int max_iter = 50;
     bool is_learning = false;
+    int solver = SOLVER_GAUSS_SEIDEL; // x-step のソルバ
+    int tv_solver = TV_SPLIT_BREGMAN;
 };
 
+// 実行で最終的に使われたパラメータ (学習ありなら推定値、なしなら入力のまま)。
+// タイル実行で一度だけ学習した値を全タイルに配るのに使う
+struct LearnedParams {
+    double lambda = 0.0, alpha = 0.0, sigma_sq = 0.0;
+    double gamma_sq = 0.0; // HGMRF のみ
+};
+
+// 進捗報告の間引き設定。開始・収束・最終反復などの報告は常に行う
+struct ProgressPolicy {
+    int every_k = 1;             // k 反復ごとに報告
+    double every_ms = 0.0;       // 前回の報告から t ミリ秒以上経過したときだけ報告 (0: 時間で間引かない)
+    bool compute_metrics = true; // false なら途中の報告で PSNR/SSIM を計算しない (0 を返す)
+    bool compute_heatmap = false; // 報告ごとに SSIM ヒートマップも計算する
+    // 途中の報告をバックグラウンドのスレッドで評価する (ネイティブと pthread 版 WASM)。ソルバはスナップショットを
+    // 三重バッファに置いて先へ進み、評価が追いつかない分は捨てる。強制報告は溜まった分を処理してから同期的に行う。
+    // コールバックは指標スレッドから呼ばれるので、JS の関数を呼ぶ場合は JS スレッドへ転送すること (main.cpp)
+    bool async_metrics = false;
+};
+
+class Solver;
+
 class DenoiseEngine {
 public:
     DenoiseEngine(int width, int height);
+    ~DenoiseEngine();
+    // 連続した w*h 画素のバッファ 2 つから取り込む。size が w*h でなければ invalid_argument (短いバッファを読み越さない)
     void set_input(const uint8_t* original_arr, const uint8_t* noisy_arr, int size);
+    // 行ストライド付きのビュー (メモリマップしたファイルやタイルの部分領域) から直接取り込む。サイズはエンジンと同じこと
+    void set_input(const utils::ImageView& original, const utils::ImageView& noisy);
     
     void gmrf(const GMRFParams& p, std::function<void(const IterationResult&)> on_step);
     void hgmrf(const HGMRFParams& p, std::function<void(const IterationResult&)> on_step);
     void lc_mrf(const LCMRFParams& p, std::function<void(const IterationResult&)> on_step);
     void rtv_mrf(const RTVMRFParams& p, std::function<void(const IterationResult&)> on_step);
+
+    // 再開可能な実行。start_* でソルバを用意し (開始時の報告もここで行う)、step を呼ぶたびに
+    // 予算 budget_ms ミリ秒分の反復を進める。中断は cancel で作業領域を破棄するだけでよい。
+    // 実行中のソルバは 1 つだけで、新しく開始すると前のものは破棄される
+    void start_gmrf(const GMRFParams& p, std::function<void(const IterationResult&)> on_step);
+    void start_hgmrf(const HGMRFParams& p, std::function<void(const IterationResult&)> on_step);
+    void start_lc_mrf(const LCMRFParams& p, std::function<void(const IterationResult&)> on_step);
+    void start_rtv_mrf(const RTVMRFParams& p, std::function<void(const IterationResult&)> on_step);
+    StepStatus step(double budget_ms);
+    void cancel();
     
+    // 報告設定は実行と実行の間に変更する (非同期評価のスレッドが参照するため)
+    void set_progress_policy(const ProgressPolicy& policy);
+    // 並列カーネルが使うスレッド数 (0: 論理コア数)。次回の実行から反映される
+    void set_num_threads(int threads);
+    // SSIM ヒートマップの窓 (false: 11x11 箱型窓, true: σ=1.5 のガウス窓)
+    void set_ssim_gaussian(bool gaussian);
+
     void get_output(uint8_t* out_data);
+    void get_output(const utils::MutableImageView& out);
     void get_initial_ssim_heatmap(uint8_t* out_rgba);
     void get_ssim_heatmap(uint8_t* out_rgba);
+    // 最後に終了した実行のパラメータ
+    const LearnedParams& learned_params() const { return learned; }
 
 protected:
+    friend class Solver;
+
     // 内部ユーティリティ：境界での中心化・解除を一括管理
     double prepare_work_data(std::vector<double>& centered_noisy);
-    void report_progress(int iter, double energy, const std::vector<double>& centered_x, double y_ave, const std::string& task, std::function<void(const IterationResult&)> on_step);
+    void report_progress(int iter, double energy, const std::vector<double>& centered_x, double y_ave, const std::string& task, const std::function<void(const IterationResult&)>& on_step, bool force = false);
+    void deliver_progress(const std::vector<double>& x, int iter, double energy, const std::string& task, const std::function<void(const IterationResult&)>& on_step, bool metrics, std::vector<uint8_t>& heatmap_buf, utils::ThreadPool* heatmap_pool);
 
     int w, h, n;
     std::vector<double> original_data, noisy_data, current_data, centered_original;
     int get_idx(int x, int y) const { return y * w + x; }
+
+    // ラプラシアン固有値 phi と DCT 計画 (画像サイズ固定なので遅延生成して使い回す)
+    const std::vector<double>& eigenvalues();
+    const utils::Spectrum* spectrum(); // 学習の固有値和用 (重複を畳み込んだ要約、同サイズの全エンジンで共有。畳み込めないサイズでは nullptr)
+    utils::DCT2D& dct();
+    utils::Multigrid& multigrid();
+    utils::ThreadPool& pool();
+    std::vector<double> phi_cache;
+    std::shared_ptr<const utils::Spectrum> spectrum_cache;
+    bool spectrum_checked = false;
+    std::unique_ptr<utils::DCT2D> dct_plan;
+    std::unique_ptr<utils::Multigrid> mg_plan;
+    int num_threads = 0;
+    std::unique_ptr<utils::ThreadPool> thread_pool;
+    bool ssim_gaussian = false;
+    ProgressPolicy progress;
+    std::chrono::steady_clock::time_point last_report;
+    utils::QualityAccumulator quality;
+    std::vector<uint8_t> progress_heatmap;
+
+    // 非同期の指標評価 (スレッドとスナップショットの三重バッファ)
+    struct AsyncMetrics;
+    std::unique_ptr<AsyncMetrics> async_metrics;
+    AsyncMetrics& async();
+    void drain_async_metrics();
+    void metrics_loop(); // 指標スレッドはソルバが使用中のスレッドプールを使わない
+
+    std::unique_ptr<Solver> active_solver; // start_* で開始した実行中のソルバ
+    LearnedParams learned;
 };
 
 #endif
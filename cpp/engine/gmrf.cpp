@@ -1,118 +1,203 @@
 #include "denoise_engine.hpp"
+#include "solver.hpp"
 #include "../utils/core.hpp"
 #include "../utils/numeric_guard.hpp"
+#include "../utils/stencil.hpp"
+#include "../utils/reduction.hpp"
 #include <cmath>
 #include <vector>
 #include <numeric>
 #include <algorithm>
+#include <memory>
+#include <type_traits>
 
 using namespace std;
 
-// 論文 2.1: GMRF 更新則 (学士論文ベース)
-void DenoiseEngine::gmrf(const GMRFParams& p_in, function<void(const IterationResult&)> on_step) {
-    GMRFParams p = p_in;
-    double conv_epsilon = 1.0e-3;
-    
-    // --- 1. 境界での中心化 ---
-    vector<double> centered_noisy;
-    double y_ave = prepare_work_data(centered_noisy);
-    vector<double> m = centered_noisy; // 作業用MAP解 (centered domain)
-
-    // ベースライン評価
-    report_progress(0, 0.0, m, y_ave, "INITIALIZING", on_step);
-
-    vector<double> phi(n);
-    for (int y = 0; y < h; ++y) {
-        for (int x = 0; x < w; ++x) {
-            phi[get_idx(x, y)] = 4.0 * pow(sin(M_PI * x / (2.0 * w)), 2.0) + 4.0 * pow(sin(M_PI * y / (2.0 * h)), 2.0);
+namespace {
+    // 学習 1 反復に必要な十分統計量 (1 パスで行ごとに積算する)
+    struct GMRFStats {
+        double m_sq = 0, mse = 0, diff_sq = 0, mae = 0;
+        GMRFStats& operator+=(const GMRFStats& o) {
+            m_sq += o.m_sq; mse += o.mse; diff_sq += o.diff_sq; mae += o.mae;
+            return *this;
         }
-    }
+    };
 
-    if (!p.is_learning) {
-        double inv_sigma_sq = 1.0 / utils::safe_denom(p.sigma_sq);
-        double inv_denom[5];
-        for (int nbr = 2; nbr <= 4; ++nbr) inv_denom[nbr] = 1.0 / utils::safe_denom(p.lambda + inv_sigma_sq + p.alpha * nbr);
+    // 論文 2.1: GMRF 更新則 (学士論文ベース)
+    // T は MAP 解の作業領域の型。float ではスイープが単精度で走り、学習の統計量と尤度は double で積算する
+    template <class T>
+    class GMRFSolver : public Solver {
+    public:
+        GMRFSolver(DenoiseEngine& engine, const GMRFParams& p_in, Callback cb) : Solver(engine, std::move(cb)), p(p_in) {
+            // --- 1. 境界での中心化 ---
+            prepare(centered_noisy);
+            m.assign(centered_noisy.begin(), centered_noisy.end()); // 作業用MAP解 (centered domain)
+            if (!is_same<T, double>::value) y_work.assign(centered_noisy.begin(), centered_noisy.end());
 
-        for (int iter = 1; iter <= 100; ++iter) {
-            vector<double> m_old = m;
-            for (int y = 0; y < h; ++y) {
-                for (int x = 0; x < w; ++x) {
-                    int i = get_idx(x, y);
-                    double sum_m = 0.0; int neighbors = 0;
-                    if (x > 0) { sum_m += m[get_idx(x - 1, y)]; neighbors++; }
-                    if (x < w - 1) { sum_m += m[get_idx(x + 1, y)]; neighbors++; }
-                    if (y > 0) { sum_m += m[get_idx(x, y - 1)]; neighbors++; }
-                    if (y < h - 1) { sum_m += m[get_idx(x, y + 1)]; neighbors++; }
-                    m[i] = (centered_noisy[i] * inv_sigma_sq + p.alpha * sum_m) * inv_denom[neighbors];
+            // ベースライン評価
+            report(0, 0.0, m, "INITIALIZING", true);
+
+            spectral = (p.solver == SOLVER_SPECTRAL);
+            multigrid_mode = (p.solver == SOLVER_MULTIGRID);
+            red_black = (p.solver == SOLVER_RED_BLACK);
+            if (spectral) dct().forward(centered_noisy, y_hat);
+            m_old = m;
+        }
+
+    protected:
+        bool advance() override {
+            double inv_sigma_sq = 1.0 / utils::safe_denom(p.sigma_sq);
+
+            if (!p.is_learning) {
+                if (spectral || multigrid_mode) {
+                    if (spectral) solve_spectral(inv_sigma_sq);
+                    else solve_multigrid(inv_sigma_sq);
+                    report(p.max_iter, 0.0, m, "CONVERGED", true);
+                    return true;
                 }
+                // ガウス・ザイデル法は 1 スイープずつ進める (最大 100 スイープ)
+                utils::ScreenedPoisson op(p.lambda + inv_sigma_sq, p.alpha, inv_sigma_sq);
+                m_old = m;
+                sweep(op);
+                double diff = 0;
+                for (int i = 0; i < n; ++i) diff += abs(static_cast<double>(m[i]) - m_old[i]);
+                if ((diff / static_cast<double>(n)) < conv_epsilon || ++iter >= 100) {
+                    report(p.max_iter, 0.0, m, "CONVERGED", true);
+                    return true;
+                }
+                return false;
             }
-            double diff = 0;
-            for (int i = 0; i < n; ++i) diff += abs(m[i] - m_old[i]);
-            if ((diff / static_cast<double>(n)) < conv_epsilon) break;
-        }
-        report_progress(p.max_iter, 0.0, m, y_ave, "CONVERGED", on_step);
-        return;
-    }
 
-    for (int iter = 1; iter <= p.max_iter; ++iter) {
-        vector<double> m_old = m;
-        double inv_sigma_sq = 1.0 / utils::safe_denom(p.sigma_sq);
-        double inv_denom[5];
-        for (int nbr = 2; nbr <= 4; ++nbr) inv_denom[nbr] = 1.0 / utils::safe_denom(p.lambda + inv_sigma_sq + p.alpha * nbr);
+            if (iter >= p.max_iter) return true;
+            ++iter;
+
+            // 1. MAP Estimation
+            if (spectral) {
+                solve_spectral(inv_sigma_sq);
+            } else if (multigrid_mode) {
+                solve_multigrid(inv_sigma_sq);
+            } else {
+                utils::ScreenedPoisson op(p.lambda + inv_sigma_sq, p.alpha, inv_sigma_sq);
+                for (int step = 0; step < 2; ++step) sweep(op);
+            }
 
-        // 1. MAP Estimation
-        for (int step = 0; step < 2; ++step) {
-            for (int y = 0; y < h; ++y) {
+            // 2. Parameter Learning (MLE)
+            // 二乗和・差分・MAE を 1 パスで集計し、同じパスで m_old を次反復用に更新する
+            GMRFStats st = utils::reduce_rows(pool(), h, row_stats, [&](int y, GMRFStats& s) {
+                int row = y * w;
+                bool has_down = (y < h - 1);
                 for (int x = 0; x < w; ++x) {
-                    int i = get_idx(x, y);
-                    double sum_m = 0.0; int neighbors = 0;
-                    if (x > 0) { sum_m += m[get_idx(x - 1, y)]; neighbors++; }
-                    if (x < w - 1) { sum_m += m[get_idx(x + 1, y)]; neighbors++; }
-                    if (y > 0) { sum_m += m[get_idx(x, y - 1)]; neighbors++; }
-                    if (y < h - 1) { sum_m += m[get_idx(x, y + 1)]; neighbors++; }
-                    m[i] = (centered_noisy[i] * inv_sigma_sq + p.alpha * sum_m) * inv_denom[neighbors];
+                    int i = row + x;
+                    double mi = m[i], r = centered_noisy[i] - mi;
+                    s.m_sq += mi * mi;
+                    s.mse += r * r;
+                    if (x < w - 1) { double d = mi - m[i + 1]; s.diff_sq += d * d; }
+                    if (has_down) { double d = mi - m[i + w]; s.diff_sq += d * d; }
+                    s.mae += abs(mi - m_old[i]);
+                    m_old[i] = m[i];
                 }
+            });
+            // 固有値に関する和は異なる固有値ごとに重複度を掛けて評価する
+            double sum_inv_psi = 0, sum_inv_chi = 0, sum_phi_psi = 0, sum_phi_chi = 0;
+            for_each_eigenvalue([&](double phi_k, double count) {
+                double psi = p.lambda + p.alpha * phi_k, chi = inv_sigma_sq + psi;
+                double inv_psi = count / utils::safe_denom(psi), inv_chi = count / utils::safe_denom(chi);
+                sum_inv_psi += inv_psi; sum_inv_chi += inv_chi;
+                sum_phi_psi += phi_k * inv_psi; sum_phi_chi += phi_k * inv_chi;
+            });
+            double inv_n = 1.0 / static_cast<double>(n);
+            double inv_2n = 0.5 * inv_n;
+            double mse_m = st.mse, mae = st.mae;
+
+            double grad_l = -st.m_sq * inv_2n - sum_inv_chi * inv_2n + sum_inv_psi * inv_2n;
+            double grad_a = -st.diff_sq * inv_2n - sum_phi_chi * inv_2n + sum_phi_psi * inv_2n;
+
+            p.sigma_sq = max(0.1, mse_m * inv_n + sum_inv_chi * inv_n);
+            p.lambda = max(1e-18, p.lambda + p.eta_lambda * grad_l);
+            p.alpha = max(1e-18, p.alpha + p.eta_alpha * grad_a);
+
+            // 周辺尤度の計算
+            double log_det_term = 0;
+            for_each_eigenvalue([&](double phi_k, double count) {
+                double psi = p.lambda + p.alpha * phi_k;
+                double chi = inv_sigma_sq + psi;
+                log_det_term += count * (log(utils::safe_denom(psi)) - log(utils::safe_denom(chi)));
+            });
+            double current_likelihood = 0.5 * log_det_term * inv_n - 0.5 * log(2.0 * M_PI * utils::safe_denom(p.sigma_sq)) - mse_m / (2.0 * utils::safe_denom(p.sigma_sq) * n);
+
+            bool converged = (mae * inv_n) < conv_epsilon;
+            if (iter % 10 == 0 || iter == p.max_iter || converged) {
+                report(iter, current_likelihood, m, "STABLE", iter == p.max_iter || converged);
             }
+            return converged || iter >= p.max_iter;
         }
-        
-        // 2. Parameter Learning (MLE)
-        double m_sq_sum = 0.0, diff_m_sq = 0.0, mse_m = 0.0, sum_inv_chi = 0.0, sum_inv_psi = 0.0, sum_phi_chi = 0.0, sum_phi_psi = 0.0;
-        double inv_n = 1.0 / static_cast<double>(n);
-        double inv_2n = 0.5 * inv_n;
-
-        for (int i = 0; i < n; ++i) {
-            m_sq_sum += m[i] * m[i];
-            mse_m += pow(centered_noisy[i] - m[i], 2.0);
-            int x = i % w, y = i / w;
-            if (x < w - 1) diff_m_sq += pow(m[i] - m[get_idx(x + 1, y)], 2.0);
-            if (y < h - 1) diff_m_sq += pow(m[i] - m[get_idx(x, y + 1)], 2.0);
-            double psi = p.lambda + p.alpha * phi[i], chi = inv_sigma_sq + psi;
-            double inv_psi = 1.0 / utils::safe_denom(psi), inv_chi = 1.0 / utils::safe_denom(chi);
-            sum_inv_psi += inv_psi; sum_inv_chi += inv_chi;
-            sum_phi_psi += phi[i] * inv_psi; sum_phi_chi += phi[i] * inv_chi;
+
+    private:
+        // スペクトル解法: (λ + 1/σ² + αL) m = y/σ² を DCT 領域で厳密に解く
+        void solve_spectral(double inv_sigma_sq) {
+            const vector<double>& phi = eigenvalues();
+            m_hat.resize(n);
+            for (int i = 0; i < n; ++i) {
+                m_hat[i] = y_hat[i] * inv_sigma_sq / utils::safe_denom(p.lambda + inv_sigma_sq + p.alpha * phi[i]);
+            }
+            with_double([&](vector<double>& x) { dct().inverse(m_hat, x); });
+        }
+
+        // マルチグリッド解法: 同じ系を V サイクル前処理付き CG で解く (前回の m から warm start)
+        void solve_multigrid(double inv_sigma_sq) {
+            rhs.resize(n);
+            for (int i = 0; i < n; ++i) rhs[i] = centered_noisy[i] * inv_sigma_sq;
+            with_double([&](vector<double>& x) { multigrid().solve(p.lambda + inv_sigma_sq, p.alpha, rhs, x); });
         }
-        double grad_l = -m_sq_sum * inv_2n - sum_inv_chi * inv_2n + sum_inv_psi * inv_2n;
-        double grad_a = -diff_m_sq * inv_2n - sum_phi_chi * inv_2n + sum_phi_psi * inv_2n;
-        
-        p.sigma_sq = max(0.1, mse_m * inv_n + sum_inv_chi * inv_n);
-        p.lambda = max(1e-18, p.lambda + p.eta_lambda * grad_l);
-        p.alpha = max(1e-18, p.alpha + p.eta_alpha * grad_a);
-
-        // 周辺尤度の計算
-        double log_det_term = 0;
-        for (int i = 0; i < n; ++i) {
-            double psi = p.lambda + p.alpha * phi[i];
-            double chi = inv_sigma_sq + psi;
-            log_det_term += log(utils::safe_denom(psi)) - log(utils::safe_denom(chi));
+
+        // DCT とマルチグリッドは double の解法なので、単精度の作業領域はいったん広げて解く
+        template <class F>
+        void with_double(F&& solve) {
+            if constexpr (is_same<T, double>::value) {
+                solve(m);
+            } else {
+                m_wide.assign(m.begin(), m.end());
+                solve(m_wide);
+                m.assign(m_wide.begin(), m_wide.end());
+            }
         }
-        double current_likelihood = 0.5 * log_det_term * inv_n - 0.5 * log(2.0 * M_PI * utils::safe_denom(p.sigma_sq)) - mse_m / (2.0 * utils::safe_denom(p.sigma_sq) * n);
 
-        double mae = 0;
-        for (int i = 0; i < n; ++i) mae += abs(m[i] - m_old[i]);
+        // スイープの右辺 (中心化した観測)。単精度では float に丸めた複製を使う
+        const vector<T>& y_centered() const {
+            if constexpr (is_same<T, double>::value) return centered_noisy;
+            else return y_work;
+        }
 
-        if (iter % 10 == 0 || iter == p.max_iter || (mae * inv_n) < conv_epsilon) {
-            report_progress(iter, current_likelihood, m, y_ave, "STABLE", on_step);
-            if ((mae * inv_n) < conv_epsilon) break;
+        // ガウス・ザイデル法: 辞書式 (論文の既定) または赤黒順序 (行バンド並列)
+        void sweep(const utils::ScreenedPoisson& op) {
+            if (red_black) utils::sweep_red_black(op, m, y_centered(), w, h, pool());
+            else utils::sweep_lexicographic(op, m, y_centered(), w, h);
         }
+
+        LearnedParams params() const override { return {p.lambda, p.alpha, p.sigma_sq, 0.0}; }
+
+        GMRFParams p;
+        const double conv_epsilon = 1.0e-3;
+        vector<double> centered_noisy, y_hat, m_hat, rhs, m_wide;
+        vector<T> m, m_old, y_work;
+        vector<GMRFStats> row_stats;
+        bool spectral = false, multigrid_mode = false, red_black = false;
+        int iter = 0;
+    };
+}
+
+namespace {
+    unique_ptr<Solver> make_gmrf_solver(DenoiseEngine& engine, const GMRFParams& p, Solver::Callback cb) {
+        if (p.precision == PRECISION_MIXED) return make_unique<GMRFSolver<float>>(engine, p, std::move(cb));
+        return make_unique<GMRFSolver<double>>(engine, p, std::move(cb));
     }
 }
+
+void DenoiseEngine::gmrf(const GMRFParams& p, function<void(const IterationResult&)> on_step) {
+    make_gmrf_solver(*this, p, std::move(on_step))->run();
+}
+
+void DenoiseEngine::start_gmrf(const GMRFParams& p, function<void(const IterationResult&)> on_step) {
+    cancel();
+    active_solver = make_gmrf_solver(*this, p, std::move(on_step));
+}
@@ -1,70 +1,111 @@
 #include "denoise_engine.hpp"
+#include "solver.hpp"
 #include "../utils/core.hpp"
 #include "../utils/numeric_guard.hpp"
+#include "../utils/stencil.hpp"
+#include "../utils/reduction.hpp"
 #include <cmath>
 #include <vector>
 #include <numeric>
 #include <algorithm>
 #include <cstdio>
+#include <memory>
 
 using namespace std;
 
-// 論文 2.2: HGMRF 更新則 (学士論文ベース)
-void DenoiseEngine::hgmrf(const HGMRFParams& p_in, function<void(const IterationResult&)> on_step) {
-    HGMRFParams p = p_in;
-    double conv_epsilon = 1.0e-3;
-    
-    // --- 1. 境界での中心化 (アルゴリズム 4.1: Line 4-6) ---
-    vector<double> centered_noisy;
-    double y_ave = prepare_work_data(centered_noisy);
-    // 初期値: u = v = w = y^ (アルゴリズム 4.1: Line 2)
-    vector<double> u = centered_noisy, v = centered_noisy, w_vec = centered_noisy;
-
-    // ベースライン評価
-    report_progress(0, 0.0, u, y_ave, "INITIALIZING", on_step);
-
-    // phi[i] (周波数領域の固有値)
-    vector<double> phi(n);
-    for (int y = 0; y < h; ++y) {
-        for (int x = 0; x < w; ++x) {
-            phi[get_idx(x, y)] = 4.0 * pow(sin(M_PI * x / (2.0 * w)), 2.0) + 4.0 * pow(sin(M_PI * y / (2.0 * h)), 2.0);
+namespace {
+    // 学習 1 反復に必要な十分統計量 (1 パスで行ごとに積算する)
+    struct HGMRFStats {
+        double mse_u = 0, u_sq = 0, v_sq = 0, w_sq = 0, diff_u = 0, diff_w = 0, mae = 0;
+        HGMRFStats& operator+=(const HGMRFStats& o) {
+            mse_u += o.mse_u; u_sq += o.u_sq; v_sq += o.v_sq; w_sq += o.w_sq;
+            diff_u += o.diff_u; diff_w += o.diff_w; mae += o.mae;
+            return *this;
         }
-    }
+    };
 
-    if (!p.is_learning) {
-        for (int iter = 1; iter <= 100; ++iter) {
-            vector<double> u_old = u;
-            for (int y = 0; y < h; ++y) {
-                for (int x = 0; x < w; ++x) {
-                    int i = get_idx(x, y);
-                    double sum_u = 0.0; int neighbors = 0;
-                    if (x > 0) { sum_u += u[get_idx(x - 1, y)]; neighbors++; }
-                    if (x < w - 1) { sum_u += u[get_idx(x + 1, y)]; neighbors++; }
-                    if (y > 0) { sum_u += u[get_idx(x, y - 1)]; neighbors++; }
-                    if (y < h - 1) { sum_u += u[get_idx(x, y + 1)]; neighbors++; }
-                    double d_u = p.lambda + 1.0 / utils::safe_denom(p.sigma_sq) + p.alpha * neighbors;
-                    u[i] = (centered_noisy[i] / utils::safe_denom(p.sigma_sq) + p.alpha * sum_u) / utils::safe_denom(d_u);
-                }
-            }
-            double diff = 0;
-            for (int i = 0; i < n; ++i) diff += abs(u[i] - u_old[i]);
-            if ((diff / n) < conv_epsilon) break;
+    // 論文 2.2: HGMRF 更新則 (学士論文ベース)
+    class HGMRFSolver : public Solver {
+    public:
+        HGMRFSolver(DenoiseEngine& engine, const HGMRFParams& p_in, Callback cb) : Solver(engine, std::move(cb)), p(p_in) {
+            // --- 1. 境界での中心化 (アルゴリズム 4.1: Line 4-6) ---
+            prepare(centered_noisy);
+            // 初期値: u = v = w = y^ (アルゴリズム 4.1: Line 2)
+            u = centered_noisy; v = centered_noisy; w_vec = centered_noisy;
+
+            // ベースライン評価
+            report(0, 0.0, u, "INITIALIZING", true);
+
+            // スペクトル解法: 周波数ごとに a = λ + αφ とすると u/v/w の連立系は
+            //   (a + γ²) V = a U,  (a + 1/σ²) U = Y/σ² + γ² V,  a W = V
+            // に分離され、U = Y / (σ² χ_h), V = a U / (a + γ²), W = U / (a + γ²) と厳密に解ける
+            spectral = (p.solver == SOLVER_SPECTRAL);
+            if (spectral) dct().forward(centered_noisy, y_hat);
+
+            // マルチグリッド解法: u/v はブロックガウス・ザイデル (各ブロックを MG で厳密に解く)、w は単独の系
+            multigrid_mode = (p.solver == SOLVER_MULTIGRID);
+            rhs.resize(multigrid_mode ? n : 0);
+
+            // ガウス・ザイデル法: 辞書式 (論文の既定) または赤黒順序 (行バンド並列)
+            red_black = (p.solver == SOLVER_RED_BLACK);
+            u_old = u;
         }
-        report_progress(p.max_iter, 0.0, u, y_ave, "CONVERGED", on_step);
-        return;
-    }
-
-    double prev_likelihood = -1e18;
-    vector<double> diff_history;
-    double prev_ma = -1e18;
-
-    for (int iter = 1; iter <= p.max_iter; ++iter) {
-        vector<double> u_old = u;
-        
-        // --- MAP Estimation (Algorithm 4.1: Line 8-16) ---
-        for (int step = 0; step < 2; ++step) { 
-            for (int y = 0; y < h; ++y) {
-                for (int x = 0; x < w; ++x) {
+
+    protected:
+        bool advance() override {
+            if (!p.is_learning) return advance_map_only();
+            if (iter >= p.max_iter) return true;
+            ++iter;
+
+            // --- MAP Estimation (Algorithm 4.1: Line 8-16) ---
+            if (spectral) {
+                const vector<double>& phi = eigenvalues();
+                double inv_sigma_sq = 1.0 / utils::safe_denom(p.sigma_sq);
+                u_hat.resize(n); v_hat.resize(n); w_hat.resize(n);
+                for (int i = 0; i < n; ++i) {
+                    double a = p.lambda + p.alpha * phi[i];
+                    double inv_ag = 1.0 / utils::safe_denom(a + p.gamma_sq);
+                    double chi_h = inv_sigma_sq + a * a * inv_ag;
+                    u_hat[i] = y_hat[i] * inv_sigma_sq / utils::safe_denom(chi_h);
+                    v_hat[i] = a * u_hat[i] * inv_ag;
+                    w_hat[i] = u_hat[i] * inv_ag;
+                }
+                dct().inverse(u_hat, u);
+                dct().inverse(v_hat, v);
+                dct().inverse(w_hat, w_vec);
+            } else if (multigrid_mode) {
+                double inv_sigma_sq = 1.0 / utils::safe_denom(p.sigma_sq);
+                for (int step = 0; step < 2; ++step) {
+                    // (λ + 1/σ² + αL) u = y/σ² + γ² v
+                    for (int i = 0; i < n; ++i) rhs[i] = centered_noisy[i] * inv_sigma_sq + p.gamma_sq * v[i];
+                    multigrid().solve(p.lambda + inv_sigma_sq, p.alpha, rhs, u);
+                    // (λ + γ² + αL) v = (λ + αL) u
+                    for (int y = 0; y < h; ++y) {
+                        for (int x = 0; x < w; ++x) {
+                            int i = get_idx(x, y);
+                            double sum_u = 0.0; int neighbors = 0;
+                            if (x > 0) { sum_u += u[i - 1]; neighbors++; }
+                            if (x < w - 1) { sum_u += u[i + 1]; neighbors++; }
+                            if (y > 0) { sum_u += u[i - w]; neighbors++; }
+                            if (y < h - 1) { sum_u += u[i + w]; neighbors++; }
+                            rhs[i] = (p.lambda + p.alpha * neighbors) * u[i] - p.alpha * sum_u;
+                        }
+                    }
+                    multigrid().solve(p.lambda + p.gamma_sq, p.alpha, rhs, v);
+                }
+                // (λ + αL) w = v
+                multigrid().solve(p.lambda, p.alpha, v, w_vec);
+            } else {
+                // 係数は反復中一定なので近傍数ごとに先に求めておく (画素ごとの除算をなくす)
+                double inv_sigma_sq = 1.0 / utils::safe_denom(p.sigma_sq);
+                double inv_du[5], inv_dv[5], prec_u[5];
+                for (int nbr = 0; nbr <= 4; ++nbr) {
+                    inv_du[nbr] = 1.0 / utils::safe_denom(p.lambda + inv_sigma_sq + p.alpha * nbr);
+                    inv_dv[nbr] = 1.0 / utils::safe_denom(p.lambda + p.gamma_sq + p.alpha * nbr);
+                    prec_u[nbr] = p.lambda + p.alpha * nbr;
+                }
+                // u_i, v_i を同じ画素で続けて更新する (v_i は更新直後の u_i を使う)
+                auto update_uv = [&](int x, int y) {
                     int i = get_idx(x, y);
                     double sum_u = 0.0, sum_v_u = 0.0;
                     int neighbors = 0;
@@ -72,120 +113,194 @@ void DenoiseEngine::hgmrf(const HGMRFParams& p_in, function<void(const Iteration
                     if (x < w - 1) { int ni = get_idx(x + 1, y); sum_u += u[ni]; sum_v_u += (v[ni] - u[ni]); neighbors++; }
                     if (y > 0) { int ni = get_idx(x, y - 1); sum_u += u[ni]; sum_v_u += (v[ni] - u[ni]); neighbors++; }
                     if (y < h - 1) { int ni = get_idx(x, y + 1); sum_u += u[ni]; sum_v_u += (v[ni] - u[ni]); neighbors++; }
-                    
+
                     // u_i 更新則 (論文 Algorithm 4.1: Line 13)
-                    double d_u = p.lambda + 1.0 / utils::safe_denom(p.sigma_sq) + p.alpha * neighbors; 
-                    u[i] = (centered_noisy[i] / utils::safe_denom(p.sigma_sq) + p.gamma_sq * v[i] + p.alpha * sum_u) / utils::safe_denom(d_u);
-                    
+                    u[i] = (centered_noisy[i] * inv_sigma_sq + p.gamma_sq * v[i] + p.alpha * sum_u) * inv_du[neighbors];
+
                     // v_i 更新則 (論文 Algorithm 4.1: Line 14)
-                    double d_v = p.lambda + p.gamma_sq + p.alpha * neighbors;
-                    v[i] = ((p.lambda + p.alpha * neighbors) * u[i] + p.alpha * sum_v_u) / utils::safe_denom(d_v);
+                    v[i] = (prec_u[neighbors] * u[i] + p.alpha * sum_v_u) * inv_dv[neighbors];
+                };
+                // 内部画素は近傍数 4 が確定しているので境界分岐を持たない版を使う
+                double d_u4 = inv_du[4], d_v4 = inv_dv[4], prec_u4 = prec_u[4];
+                auto update_uv_interior = [&](int i) {
+                    double sum_u = u[i - 1] + u[i + 1] + u[i - w] + u[i + w];
+                    double sum_v_u = (v[i - 1] - u[i - 1]) + (v[i + 1] - u[i + 1]) + (v[i - w] - u[i - w]) + (v[i + w] - u[i + w]);
+                    u[i] = (centered_noisy[i] * inv_sigma_sq + p.gamma_sq * v[i] + p.alpha * sum_u) * d_u4;
+                    v[i] = (prec_u4 * u[i] + p.alpha * sum_v_u) * d_v4;
+                };
+                auto update_uv_row = [&](int y, int x0, int stride) {
+                    if (y == 0 || y == h - 1 || w < 3) {
+                        for (int x = x0; x < w; x += stride) update_uv(x, y);
+                        return;
+                    }
+                    if (x0 == 0) update_uv(0, y);
+                    int row = y * w;
+                    for (int x = (x0 == 0 ? stride : x0); x < w - 1; x += stride) update_uv_interior(row + x);
+                    if ((w - 1 - x0) % stride == 0) update_uv(w - 1, y);
+                };
+                for (int step = 0; step < 2; ++step) {
+                    if (red_black) {
+                        utils::sweep_red_black_rows(pool(), h, [&](int y, int x0) { update_uv_row(y, x0, 2); });
+                    } else {
+                        for (int y = 0; y < h; ++y) update_uv_row(y, 0, 1);
+                    }
                 }
+
+                // --- Bias Estimation (w) (Algorithm 4.1: Line 18-24) ---
+                utils::ScreenedPoisson op_w(p.lambda, p.alpha);
+                for (int step = 0; step < 2; ++step) sweep(op_w, w_vec, v);
             }
-        }
 
-        // --- Bias Estimation (w) (Algorithm 4.1: Line 18-24) ---
-        for (int step = 0; step < 2; ++step) {
-            for (int y = 0; y < h; ++y) {
+            // --- Parameter Learning (MLE) (Algorithm 4.1: Line 28-32) ---
+            // 二乗和・差分・MAE を 1 パスで集計し、同じパスで u_old を次反復用に更新する
+            double inv_sigma_sq = 1.0 / utils::safe_denom(p.sigma_sq);
+            HGMRFStats st = utils::reduce_rows(pool(), h, row_stats, [&](int y, HGMRFStats& s) {
+                int row = y * w;
+                bool has_down = (y < h - 1);
                 for (int x = 0; x < w; ++x) {
-                    int i = get_idx(x, y);
-                    double sum_w = 0; int neighbors = 0;
-                    if (x > 0) { sum_w += w_vec[get_idx(x-1, y)]; neighbors++; }
-                    if (x < w - 1) { sum_w += w_vec[get_idx(x+1, y)]; neighbors++; }
-                    if (y > 0) { sum_w += w_vec[get_idx(x, y-1)]; neighbors++; }
-                    if (y < h - 1) { sum_w += w_vec[get_idx(x, y+1)]; neighbors++; }
-                    w_vec[i] = (v[i] + p.alpha * sum_w) / utils::safe_denom(p.lambda + p.alpha * neighbors);
+                    int i = row + x;
+                    double ui = u[i], wi = w_vec[i], r = centered_noisy[i] - ui;
+                    s.mse_u += r * r;
+                    s.u_sq += ui * ui; s.v_sq += v[i] * v[i]; s.w_sq += wi * wi;
+                    if (x < w - 1) {
+                        double du = ui - u[i + 1], dw = wi - w_vec[i + 1];
+                        s.diff_u += du * du; s.diff_w += dw * dw;
+                    }
+                    if (has_down) {
+                        double du = ui - u[i + w], dw = wi - w_vec[i + w];
+                        s.diff_u += du * du; s.diff_w += dw * dw;
+                    }
+                    s.mae += abs(ui - u_old[i]);
+                    u_old[i] = ui;
                 }
-            }
-        }
+            });
+            double mse_u = st.mse_u, mae = st.mae;
+            double u_sq = st.u_sq, v_sq = st.v_sq, w_sq = st.w_sq, diff_u = st.diff_u, diff_w = st.diff_w;
 
-        // --- Parameter Learning (MLE) (Algorithm 4.1: Line 28-32) ---
-        double mse_u = 0;
-        for (int i = 0; i < n; ++i) mse_u += pow(centered_noisy[i] - u[i], 2);
-
-        double grad_l = 0, grad_a = 0, grad_g = 0, u_sq = 0, v_sq = 0, w_sq = 0, diff_u = 0, diff_w = 0, sum_inv_chi = 0;
-        for (int i = 0; i < n; ++i) {
-            u_sq += u[i] * u[i]; v_sq += v[i] * v[i]; w_sq += w_vec[i] * w_vec[i];
-            int x = i % w, y = i / w;
-            if (x < w - 1) { 
-                diff_u += pow(u[i]-u[get_idx(x+1,y)], 2); 
-                diff_w += pow(w_vec[i]-w_vec[get_idx(x+1,y)], 2); 
-            }
-            if (y < h - 1) { 
-                diff_u += pow(u[i]-u[get_idx(x,y+1)], 2); 
-                diff_w += pow(w_vec[i]-w_vec[get_idx(x,y+1)], 2); 
-            }
+            // 周辺尤度の微分項 (Appendix C: 式 C.13)。異なる固有値ごとに重複度を掛けて評価する
+            double grad_l = 0, grad_a = 0, grad_g = 0, sum_inv_chi = 0;
+            for_each_eigenvalue([&](double phi_k, double count) {
+                double a = p.lambda + p.alpha * phi_k;
+                double t2 = 1.0 / utils::safe_denom(p.gamma_sq + a);
+                double psi_h = a * a * t2;
+                double inv_chi = count / utils::safe_denom(inv_sigma_sq + psi_h);
+                double dt = 2.0 / utils::safe_denom(a) - t2;
+                grad_l += inv_chi * dt;
+                grad_g -= inv_chi * t2;
+                grad_a += phi_k * inv_chi * dt;
+                sum_inv_chi += inv_chi;
+            });
             
-            // 周辺尤度の微分項 (Appendix C: 式 C.13)
-            double psi_h = pow(p.lambda + p.alpha * phi[i], 2) / utils::safe_denom(p.gamma_sq + p.lambda + p.alpha * phi[i]);
-            double chi_h = 1.0 / utils::safe_denom(p.sigma_sq) + psi_h;
-            double t1 = 2.0 / utils::safe_denom(p.lambda + p.alpha * phi[i]), t2 = 1.0 / utils::safe_denom(p.gamma_sq + p.lambda + p.alpha * phi[i]);
-            double dt = t1 - t2;
-            
-            grad_l += (1.0 / utils::safe_denom(chi_h)) * dt;
-            grad_g += (1.0 / utils::safe_denom(chi_h)) * (-t2);
-            grad_a += (phi[i] / utils::safe_denom(chi_h)) * dt;
-            sum_inv_chi += 1.0 / utils::safe_denom(chi_h);
-        }
-        
-        // 勾配の集約 (Appendix C: 式 C.12)
-        grad_l = -u_sq/(2.*n) + (p.gamma_sq*p.gamma_sq*w_sq)/(2.*n) + grad_l/(2.*n*utils::safe_denom(p.sigma_sq));
-        grad_g = -v_sq/(2.*n) - grad_g/(2.*n*utils::safe_denom(p.sigma_sq));
-        grad_a = -diff_u/(2.*n) + (p.gamma_sq*p.gamma_sq*diff_w)/(2.*n) + grad_a/(2.*n*utils::safe_denom(p.sigma_sq));
-
-        p.lambda = max(1e-18, p.lambda + p.eta_lambda * grad_l);
-        p.alpha = max(1e-18, p.alpha + p.eta_alpha * grad_a);
-        p.gamma_sq = max(1e-18, p.gamma_sq + p.eta_gamma2 * grad_g);
-        // sigma^2 更新則修正 (周辺尤度最大化の停留条件)
-        p.sigma_sq = max(0.1, mse_u / n + sum_inv_chi / n); 
-
-        // --- 周辺対数尤度の計算 (アルゴリズム 4.1: Line 25) ---
-        double log_det_term = 0;
-        for (int i = 0; i < n; ++i) {
-            double psi_h = pow(p.lambda + p.alpha * phi[i], 2) / utils::safe_denom(p.gamma_sq + p.lambda + p.alpha * phi[i]);
-            double chi_h = 1.0 / utils::safe_denom(p.sigma_sq) + psi_h;
-            log_det_term += log(utils::safe_denom(psi_h)) - log(utils::safe_denom(chi_h));
-        }
-        double current_likelihood = 0.5 * log_det_term / n - 0.5 * log(2.0 * M_PI * utils::safe_denom(p.sigma_sq)) - mse_u / (2.0 * utils::safe_denom(p.sigma_sq) * n);
-
-        if (p.verify_likelihood) {
-            double actual_mse = 0;
-            for (int i = 0; i < n; ++i) actual_mse += pow(original_data[i] - (u[i] + y_ave), 2);
-            double actual_psnr = 10.0 * std::log10(255.0 * 255.0 / utils::safe_denom(actual_mse / n));
-
-            printf("[MONITOR] Iter %3d: L=%.6f, alpha=%.3e, lambda=%.3e, gamma2=%.3e, sigma2=%.3f, PSNR=%.2f\n",
-                   iter, current_likelihood, p.alpha, p.lambda, p.gamma_sq, p.sigma_sq, actual_psnr);
-            if (iter > 1 && current_likelihood < prev_likelihood - 1e-10) {
-                printf("  [VERIFY] Iteration %d: Likelihood decreased (diff: %.6e)\n", 
-                       iter, current_likelihood - prev_likelihood);
+            // 勾配の集約 (Appendix C: 式 C.12)
+            grad_l = -u_sq/(2.*n) + (p.gamma_sq*p.gamma_sq*w_sq)/(2.*n) + grad_l/(2.*n*utils::safe_denom(p.sigma_sq));
+            grad_g = -v_sq/(2.*n) - grad_g/(2.*n*utils::safe_denom(p.sigma_sq));
+            grad_a = -diff_u/(2.*n) + (p.gamma_sq*p.gamma_sq*diff_w)/(2.*n) + grad_a/(2.*n*utils::safe_denom(p.sigma_sq));
+
+            p.lambda = max(1e-18, p.lambda + p.eta_lambda * grad_l);
+            p.alpha = max(1e-18, p.alpha + p.eta_alpha * grad_a);
+            p.gamma_sq = max(1e-18, p.gamma_sq + p.eta_gamma2 * grad_g);
+            // sigma^2 更新則修正 (周辺尤度最大化の停留条件)
+            p.sigma_sq = max(0.1, mse_u / n + sum_inv_chi / n); 
+
+            // --- 周辺対数尤度の計算 (アルゴリズム 4.1: Line 25) ---
+            double log_det_term = 0;
+            for_each_eigenvalue([&](double phi_k, double count) {
+                double a = p.lambda + p.alpha * phi_k;
+                double psi_h = a * a / utils::safe_denom(p.gamma_sq + a);
+                double chi_h = 1.0 / utils::safe_denom(p.sigma_sq) + psi_h;
+                log_det_term += count * (log(utils::safe_denom(psi_h)) - log(utils::safe_denom(chi_h)));
+            });
+            double current_likelihood = 0.5 * log_det_term / n - 0.5 * log(2.0 * M_PI * utils::safe_denom(p.sigma_sq)) - mse_u / (2.0 * utils::safe_denom(p.sigma_sq) * n);
+
+            if (p.verify_likelihood) {
+                const vector<double>& original_data = original();
+                double actual_mse = 0;
+                for (int i = 0; i < n; ++i) actual_mse += pow(original_data[i] - (u[i] + y_ave), 2);
+                double actual_psnr = 10.0 * std::log10(255.0 * 255.0 / utils::safe_denom(actual_mse / n));
+
+                printf("[MONITOR] Iter %3d: L=%.6f, alpha=%.3e, lambda=%.3e, gamma2=%.3e, sigma2=%.3f, PSNR=%.2f\n",
+                       iter, current_likelihood, p.alpha, p.lambda, p.gamma_sq, p.sigma_sq, actual_psnr);
+                if (iter > 1 && current_likelihood < prev_likelihood - 1e-10) {
+                    printf("  [VERIFY] Iteration %d: Likelihood decreased (diff: %.6e)\n", 
+                           iter, current_likelihood - prev_likelihood);
+                }
             }
-        }
 
-        double mae = 0;
-        for (int i = 0; i < n; ++i) mae += abs(u[i] - u_old[i]);
+            report(iter, current_likelihood, u, "OPTIMIZING", iter == p.max_iter);
+
+            // --- 尤度差分の移動平均によるピーク検出 (アルゴリズム 4.2) ---
+            if (iter > 1) {
+                diff_history.push_back(current_likelihood - prev_likelihood);
+                if (diff_history.size() > 7) diff_history.erase(diff_history.begin());
+            }
+            prev_likelihood = current_likelihood;
 
-        report_progress(iter, current_likelihood, u, y_ave, "OPTIMIZING", on_step);
+            if (diff_history.size() == 7) {
+                double current_ma = accumulate(diff_history.begin(), diff_history.end(), 0.0) / 7.0;
+                // ピーク検出: 移動平均が減少に転じた瞬間
+                if (iter > 7 && current_ma < prev_ma && prev_ma > -1e10) {
+                    report(iter, current_likelihood, u, "OPTIMAL PEAK FOUND (EARLY STOPPING)", true);
+                    return true;
+                }
+                prev_ma = current_ma;
+            }
 
-        // --- 尤度差分の移動平均によるピーク検出 (アルゴリズム 4.2) ---
-        if (iter > 1) {
-            diff_history.push_back(current_likelihood - prev_likelihood);
-            if (diff_history.size() > 7) diff_history.erase(diff_history.begin());
+            if ((mae / n) < conv_epsilon) {
+                report(iter, current_likelihood, u, "CONVERGED", true);
+                return true;
+            }
+            return iter >= p.max_iter;
         }
-        prev_likelihood = current_likelihood;
-
-        if (diff_history.size() == 7) {
-            double current_ma = accumulate(diff_history.begin(), diff_history.end(), 0.0) / 7.0;
-            // ピーク検出: 移動平均が減少に転じた瞬間
-            if (iter > 7 && current_ma < prev_ma && prev_ma > -1e10) {
-                report_progress(iter, current_likelihood, u, y_ave, "OPTIMAL PEAK FOUND (EARLY STOPPING)", on_step);
-                break; 
+
+    private:
+        // 学習なし: スペクトル/マルチグリッドは 1 回で厳密に解き、ガウス・ザイデル法は 1 スイープずつ進める
+        bool advance_map_only() {
+            double inv_sigma_sq = 1.0 / utils::safe_denom(p.sigma_sq);
+            if (spectral) {
+                const vector<double>& phi = eigenvalues();
+                u_hat.resize(n);
+                for (int i = 0; i < n; ++i) u_hat[i] = y_hat[i] * inv_sigma_sq / utils::safe_denom(p.lambda + inv_sigma_sq + p.alpha * phi[i]);
+                dct().inverse(u_hat, u);
+            } else if (multigrid_mode) {
+                for (int i = 0; i < n; ++i) rhs[i] = centered_noisy[i] * inv_sigma_sq;
+                multigrid().solve(p.lambda + inv_sigma_sq, p.alpha, rhs, u);
+            } else {
+                utils::ScreenedPoisson op(p.lambda + inv_sigma_sq, p.alpha, inv_sigma_sq);
+                u_old = u;
+                sweep(op, u, centered_noisy);
+                double diff = 0;
+                for (int i = 0; i < n; ++i) diff += abs(u[i] - u_old[i]);
+                if ((diff / n) >= conv_epsilon && ++iter < 100) return false;
             }
-            prev_ma = current_ma;
+            report(p.max_iter, 0.0, u, "CONVERGED", true);
+            return true;
         }
 
-        if ((mae / n) < conv_epsilon) {
-            report_progress(iter, current_likelihood, u, y_ave, "CONVERGED", on_step);
-            break;
+        void sweep(const utils::ScreenedPoisson& op, vector<double>& x, const vector<double>& b) {
+            if (red_black) utils::sweep_red_black(op, x, b, w, h, pool());
+            else utils::sweep_lexicographic(op, x, b, w, h);
         }
-    }
+
+        int get_idx(int x, int y) const { return y * w + x; }
+
+        LearnedParams params() const override { return {p.lambda, p.alpha, p.sigma_sq, p.gamma_sq}; }
+
+        HGMRFParams p;
+        const double conv_epsilon = 1.0e-3;
+        vector<double> centered_noisy, u, v, w_vec, u_old, y_hat, u_hat, v_hat, w_hat, rhs;
+        vector<HGMRFStats> row_stats;
+        bool spectral = false, multigrid_mode = false, red_black = false;
+        int iter = 0;
+        double prev_likelihood = -1e18, prev_ma = -1e18;
+        vector<double> diff_history;
+    };
+}
+
+void DenoiseEngine::hgmrf(const HGMRFParams& p, function<void(const IterationResult&)> on_step) {
+    HGMRFSolver(*this, p, std::move(on_step)).run();
+}
+
+void DenoiseEngine::start_hgmrf(const HGMRFParams& p, function<void(const IterationResult&)> on_step) {
+    cancel();
+    active_solver = make_unique<HGMRFSolver>(*this, p, std::move(on_step));
 }
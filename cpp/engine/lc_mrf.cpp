@@ -1,172 +1,388 @@
 #include "denoise_engine.hpp"
+#include "solver.hpp"
 #include "../utils/core.hpp"
 #include "../utils/numeric_guard.hpp"
+#include "../utils/rng.hpp"
+#include "../utils/simd.hpp"
 #include <cmath>
 #include <vector>
 #include <numeric>
 #include <algorithm>
+#include <memory>
+#include <type_traits>
 
 using namespace std;
 
 // MALAサンプリング用の内部ヘルパー
 namespace {
-    double stable_log_cosh(double x) {
-        double a = abs(x);
-        return a + log1p(exp(-2.0 * a)) - 0.6931471805599453;
+    // エネルギーの構成要素 Σx², Σ log cosh(sΔx) (辺ごと), Σ(y-x)²
+    struct LCSums {
+        double sq = 0, lc = 0, mq = 0;
+        double energy(double lambda, double alpha, double inv_2sigma_sq) const {
+            return (lambda * 0.5) * sq + alpha * lc + inv_2sigma_sq * mq;
+        }
+    };
+
+    // 2 要素の読み書き。float の作業領域も演算は double のレーンで行う
+    inline utils::simd::f64x2 load_pair(const double* p) { return utils::simd::load(p); }
+    inline utils::simd::f64x2 load_pair(const float* p) { return utils::simd::make(p[0], p[1]); }
+    inline void store_pair(double* p, utils::simd::f64x2 v) { utils::simd::store(p, v); }
+    inline void store_pair(float* p, utils::simd::f64x2 v) {
+        p[0] = static_cast<float>(utils::simd::lane0(v)); p[1] = static_cast<float>(utils::simd::lane1(v));
+    }
+
+    // 辺 count 本分の t_k = αs·tanh(d_k), d_k = s(a_k - b_k) を求め、kEnergy なら Σ log cosh(d_k) を lc に足す。
+    // tanh と log cosh は e = exp(-2|d|) と log1p(e) から求める。どちらも多項式近似で 2 辺ずつ SIMD で計算する
+    template <bool kEnergy, class T>
+    void edge_tanh_row(const T* a, const T* b, int count, double s, double alpha_s, T* t, double& lc) {
+        using namespace utils::simd;
+        const f64x2 vs = splat(s), vas = splat(alpha_s), one = splat(1.0);
+        auto edge = [&](f64x2 va, f64x2 vb, f64x2& lc_part) {
+            f64x2 d = vs * (va - vb);
+            f64x2 m = abs(d);
+            f64x2 e = exp_nonpos(max(m * splat(-2.0), splat(-700.0))); // tanh が 1 に飽和する範囲で打ち切る
+            if (kEnergy) lc_part = (m + log1p_unit(e)) - splat(0.6931471805599453);
+            return vas * copysign((one - e) / (one + e), d);
+        };
+        f64x2 acc = splat(0.0), part = splat(0.0);
+        int k = 0;
+        for (; k + 1 < count; k += 2) {
+            store_pair(t + k, edge(load_pair(a + k), load_pair(b + k), part));
+            if (kEnergy) acc += part;
+        }
+        double sum = hsum(acc);
+        if (k < count) { // 端数の 1 辺は片方のレーンだけ使う
+            t[k] = static_cast<T>(lane0(edge(splat(a[k]), splat(b[k]), part)));
+            if (kEnergy) sum += lane0(part);
+        }
+        if (kEnergy) lc += sum;
     }
-    double calc_E_LC(const vector<double>& x, double lambda, double alpha, double s, int w, int h) {
-        double energy = 0.0;
+
+    // エネルギーと勾配を行単位の 1 パスで同時に計算する。各辺の tanh は 1 度だけ評価して両端の画素に配る。
+    // kPosterior なら事後分布 (観測項を含む)、そうでなければ事前分布 (LC 項のみ) で、画素ループ内に分岐を残さない。
+    // T = float では状態と勾配を単精度で持ち、辺の寄与の計算と総和は double で行う
+    template <bool kEnergy, bool kPosterior, class T>
+    LCSums lc_energy_grad_impl(const vector<T>& xv, const T* y_n, vector<T>& gv, double lambda, double alpha, double s, double inv_sigma_sq, int w, int h) {
+        const T* x = xv.data();
+        T* grad = gv.data();
+        double alpha_s = alpha * s;
+        LCSums sums;
+        // 横の辺の寄与 th[1..w-1] と縦の辺の寄与 tv。th の両端を 0 にしておき、境界の分岐なしで配る
+        thread_local vector<T> th, tv;
+        th.assign(w + 1, T(0));
+        tv.resize(w);
+        auto init_row = [&](int y) {
+            for (int i = y * w; i < (y + 1) * w; ++i) {
+                double g = lambda * x[i];
+                if (kPosterior) g += (static_cast<double>(x[i]) - y_n[i]) * inv_sigma_sq;
+                grad[i] = static_cast<T>(g);
+            }
+        };
+        init_row(0);
         for (int y = 0; y < h; ++y) {
+            bool has_down = (y < h - 1);
+            if (has_down) init_row(y + 1);
+            const T* xr = x + static_cast<long long>(y) * w;
+            T* gr = grad + static_cast<long long>(y) * w;
+            edge_tanh_row<kEnergy>(xr, xr + 1, w - 1, s, alpha_s, th.data() + 1, sums.lc);
+            if (has_down) edge_tanh_row<kEnergy>(xr, xr + w, w, s, alpha_s, tv.data(), sums.lc);
             for (int dx = 0; dx < w; ++dx) {
-                int i = y * w + dx;
-                energy += (lambda * 0.5) * x[i] * x[i];
-                if (dx < w - 1) energy += alpha * stable_log_cosh(s * (x[i] - x[i + 1]));
-                if (y < h - 1) energy += alpha * stable_log_cosh(s * (x[i] - x[i + w]));
+                gr[dx] = (gr[dx] - th[dx]) + th[dx + 1];
+                if (has_down) { gr[dx] += tv[dx]; gr[dx + w] -= tv[dx]; }
+            }
+            if (kEnergy) {
+                for (int dx = 0; dx < w; ++dx) {
+                    double xd = xr[dx];
+                    sums.sq += xd * xd;
+                    if (kPosterior) { double r = y_n[y * w + dx] - xd; sums.mq += r * r; }
+                }
             }
         }
-        return energy;
+        return sums;
     }
-    double calc_E_post(const vector<double>& x, const vector<double>& y_noisy, double lambda, double alpha, double inv_2sigma_sq, double s, int w, int h) {
-        double energy = calc_E_LC(x, lambda, alpha, s, w, h);
-        for (size_t i = 0; i < x.size(); ++i) energy += pow(y_noisy[i] - x[i], 2.0) * inv_2sigma_sq;
-        return energy;
+
+    // y_n が nullptr なら事前分布、そうでなければ事後分布 (呼び出しごとに一度だけ分岐する)
+    template <bool kEnergy, class T>
+    LCSums lc_energy_grad(const vector<T>& xv, const T* y_n, vector<T>& gv, double lambda, double alpha, double s, double inv_sigma_sq, int w, int h) {
+        if (y_n) return lc_energy_grad_impl<kEnergy, true>(xv, y_n, gv, lambda, alpha, s, inv_sigma_sq, w, h);
+        return lc_energy_grad_impl<kEnergy, false>(xv, y_n, gv, lambda, alpha, s, inv_sigma_sq, w, h);
     }
-    void calc_grad_LC(const vector<double>& x, vector<double>& grad, double lambda, double alpha, double s, int w, int h) {
-        double alpha_s = alpha * s;
+
+    // 辺 count 本分の Σ log cosh(s(a_k - b_k)) を lc に足す。edge_tanh_row と同じ式・同じ順序で足すので、
+    // 勾配付きで求めたエネルギーと値が一致する (tanh と勾配の配分を省く)
+    template <class T>
+    void edge_log_cosh_row(const T* a, const T* b, int count, double s, double& lc) {
+        using namespace utils::simd;
+        const f64x2 vs = splat(s);
+        auto part = [&](f64x2 va, f64x2 vb) {
+            f64x2 m = abs(vs * (va - vb));
+            f64x2 e = exp_nonpos(max(m * splat(-2.0), splat(-700.0)));
+            return (m + log1p_unit(e)) - splat(0.6931471805599453);
+        };
+        f64x2 acc = splat(0.0);
+        int k = 0;
+        for (; k + 1 < count; k += 2) acc += part(load_pair(a + k), load_pair(b + k));
+        double sum = hsum(acc);
+        if (k < count) sum += lane0(part(splat(a[k]), splat(b[k])));
+        lc += sum;
+    }
+
+    // エネルギーの成分だけを求める (直線探索の試行点用)。y_n の扱いは lc_energy_grad と同じ
+    template <class T>
+    LCSums lc_energy(const vector<T>& xv, const T* y_n, double s, int w, int h) {
+        const T* x = xv.data();
+        LCSums sums;
         for (int y = 0; y < h; ++y) {
+            const T* xr = x + static_cast<long long>(y) * w;
+            edge_log_cosh_row(xr, xr + 1, w - 1, s, sums.lc);
+            if (y < h - 1) edge_log_cosh_row(xr, xr + w, w, s, sums.lc);
             for (int dx = 0; dx < w; ++dx) {
-                int i = y * w + dx;
-                double sum_t = 0.0;
-                if (dx > 0) sum_t += tanh(s * (x[i] - x[i - 1]));
-                if (dx < w - 1) sum_t += tanh(s * (x[i] - x[i + 1]));
-                if (y > 0) sum_t += tanh(s * (x[i] - x[i - w]));
-                if (y < h - 1) sum_t += tanh(s * (x[i] - x[i + w]));
-                grad[i] = lambda * x[i] + alpha_s * sum_t;
+                double xd = xr[dx];
+                sums.sq += xd * xd;
+                if (y_n) { double r = y_n[y * w + dx] - xd; sums.mq += r * r; }
             }
         }
+        return sums;
     }
-    void calc_grad_post(const vector<double>& x, const vector<double>& y_n, vector<double>& grad, double l, double a, double inv_sigma_sq, double s, int w, int h) {
-        calc_grad_LC(x, grad, l, a, s, w, h);
-        for (size_t i = 0; i < x.size(); ++i) grad[i] += -(y_n[i] - x[i]) * inv_sigma_sq;
-    }
-    double calc_log_Q(const vector<double>& to, const vector<double>& from, const vector<double>& g_from, double inv_4eps, double eps) {
+
+    // Nesterov 加速勾配法。ステップ幅はアルミホ条件のバックトラッキングで決め、
+    // 勾配が進行方向と逆向きになったらモーメンタムを捨てて再始動する (O'Donoghue & Candès)
+    struct AcceleratedMAP {
+        vector<double> prev, y, g, trial;
+        double t = 1.0, eta = 1.0;
+
+        AcceleratedMAP(const vector<double>& m, double eta0) : prev(m), y(m), g(m.size()), trial(m.size()), eta(eta0) {}
+
+        void step(vector<double>& m, const double* y_n, double lambda, double alpha, double s, double inv_sigma_sq, int w, int h) {
+            size_t n = m.size();
+            double inv_2sigma_sq = 0.5 * inv_sigma_sq;
+            double t_next = 0.5 * (1.0 + sqrt(1.0 + 4.0 * t * t));
+            double beta = (t - 1.0) / t_next;
+            for (size_t i = 0; i < n; ++i) y[i] = m[i] + beta * (m[i] - prev[i]);
+            double f_y = lc_energy_grad<true>(y, y_n, g, lambda, alpha, s, inv_sigma_sq, w, h).energy(lambda, alpha, inv_2sigma_sq);
+            double g_sq = 0;
+            for (size_t i = 0; i < n; ++i) g_sq += g[i] * g[i];
+
+            // 試行点はエネルギーだけで判定する (勾配は次のステップで y について求め直す)
+            bool accepted = false, first_try = true;
+            for (int k = 0; k < 50; ++k) {
+                for (size_t i = 0; i < n; ++i) trial[i] = y[i] - eta * g[i];
+                double f_trial = lc_energy(trial, y_n, s, w, h).energy(lambda, alpha, inv_2sigma_sq);
+                if (f_trial <= f_y - 0.5 * eta * g_sq) { accepted = true; break; }
+                eta *= 0.5;
+                first_try = false;
+            }
+            // 十分な減少が得られなければ m は動かさず、モーメンタムを捨てて再始動する
+            if (!accepted) {
+                prev = m;
+                t = 1.0;
+                return;
+            }
+            if (first_try) eta *= 1.1; // 一度で受理されたら次は少し大きく試す
+
+            double dir = 0;
+            for (size_t i = 0; i < n; ++i) dir += g[i] * (trial[i] - m[i]);
+            swap(prev, m);
+            swap(m, trial);
+            t = (dir > 0) ? 1.0 : t_next;
+        }
+    };
+
+    // MALA 連鎖 1 本分の状態と作業領域。乱数列は連鎖ごとに独立 (seed と連鎖番号から生成)
+    // 現在状態のエネルギー成分と勾配をキャッシュし、提案が受理されたら提案側と入れ替えて再利用する
+    template <class T>
+    struct Chain {
+        vector<T> x, grad, star, g_star;
+        utils::Philox rng;
+        bool started = false;
+        LCSums cur;
+    };
+    template <class T>
+    double calc_log_Q(const vector<T>& to, const vector<T>& from, const vector<T>& g_from, double inv_4eps, double eps) {
         double norm_sq = 0.0;
         for (size_t i = 0; i < to.size(); ++i) {
-            double diff = to[i] - from[i] + eps * g_from[i];
+            double diff = (static_cast<double>(to[i]) - from[i]) + eps * g_from[i];
             norm_sq += diff * diff;
         }
         return -norm_sq * inv_4eps;
     }
-}
 
-// 論文 4.1: LC-MRF 更新則 (修士論文ベース)
-void DenoiseEngine::lc_mrf(const LCMRFParams& p_in, function<void(const IterationResult&)> on_step) {
-    LCMRFParams p = p_in;
-    
-    // --- 1. 境界での中心化 ---
-    vector<double> centered_noisy;
-    double y_ave = prepare_work_data(centered_noisy);
-    vector<double> m = centered_noisy, p_s(n), q_s(n), grad(n), g_star(n), star(n);
-
-    // ベースライン評価
-    report_progress(0, 0.0, m, y_ave, "INITIALIZING", on_step);
-
-    // 逆数プリキャル
-    double inv_n = 1.0 / static_cast<double>(n);
-    double inv_2n = 0.5 * inv_n;
-
-    if (!p.is_learning) {
-        double inv_sigma_sq = 1.0 / utils::safe_denom(p.sigma_sq);
-        for (int iter = 1; iter <= 100; ++iter) {
-            vector<double> m_old = m;
-            for (int step = 0; step < 2; ++step) {
-                calc_grad_post(m, centered_noisy, grad, p.lambda, p.alpha, inv_sigma_sq, p.s, w, h);
-                for (int i = 0; i < n; ++i) m[i] -= p.epsilon_map * grad[i];
-            }
-            double diff = 0;
-            for (int i = 0; i < n; ++i) diff += abs(m[i] - m_old[i]);
-            if ((diff / static_cast<double>(n)) < 1e-3) break;
-        }
-        report_progress(p.max_iter, 0.0, m, y_ave, "CONVERGED", on_step);
-        return;
-    }
+    // 論文 4.1: LC-MRF 更新則 (修士論文ベース)
+    // T は MALA 連鎖の状態の型。MAP 推定・連鎖の総和・パラメータ更新は常に double
+    template <class T>
+    class LCMRFSolver : public Solver {
+    public:
+        LCMRFSolver(DenoiseEngine& engine, const LCMRFParams& p_in, Callback cb) : Solver(engine, std::move(cb)), p(p_in) {
+            // --- 1. 境界での中心化 ---
+            prepare(centered_noisy);
+            m = centered_noisy;
+            grad.resize(n);
 
-    for (int iter = 1; iter <= p.max_iter; ++iter) {
-        double inv_sigma_sq = 1.0 / utils::safe_denom(p.sigma_sq);
-        double inv_2sigma_sq = 0.5 * inv_sigma_sq;
-        
-        // 1. MAP Optimization
-        for (int step = 0; step < 2; ++step) {
-            calc_grad_post(m, centered_noisy, grad, p.lambda, p.alpha, inv_sigma_sq, p.s, w, h);
-            for (int i = 0; i < n; ++i) m[i] -= p.epsilon_map * grad[i];
-        }
+            // ベースライン評価
+            report(0, 0.0, m, "INITIALIZING", true);
+
+            // 逆数プリキャル
+            inv_n = 1.0 / static_cast<double>(n);
+            inv_2n = 0.5 * inv_n;
 
-        double exp_pri_sq = 0, exp_pri_lc = 0;
-        double exp_post_sq = 0, exp_post_lc = 0, exp_post_mq = 0;
-
-        // 2. Prior Sampling (MALA)
-        double inv_4eps_pri = 1.0 / utils::safe_denom(4.0 * p.epsilon_pri);
-        double sqrt_2eps_pri = sqrt(2.0 * p.epsilon_pri);
-        for (int mu = 0; mu < p.n_pri; ++mu) {
-            fill(p_s.begin(), p_s.end(), 0.0);
-            for (int t = 0; t < p.t_hat_max; ++t) {
-                calc_grad_LC(p_s, grad, p.lambda, p.alpha, p.s, w, h);
-                for (int i = 0; i < n; ++i) {
-                    double r = sqrt(-2.0 * log((rand()+1.0)/(RAND_MAX+2.0))) * cos(2.0*M_PI*(rand()+1.0)/(RAND_MAX+2.0));
-                    star[i] = p_s[i] - p.epsilon_pri * grad[i] + sqrt_2eps_pri * r;
+            // MAP 推定の加速法の状態は学習反復をまたいで持ち越す
+            if (p.map_optimizer == MAP_NESTEROV) accel = make_unique<AcceleratedMAP>(m, p.epsilon_map);
+
+            // 事前分布の連鎖 [0, n_pri) と事後分布の連鎖 [n_pri, n_pri + n_post)
+            if (p.is_learning) {
+                if (!is_same<T, double>::value) y_chain.assign(centered_noisy.begin(), centered_noisy.end());
+                chains.resize(p.n_pri + p.n_post);
+                for (size_t c = 0; c < chains.size(); ++c) {
+                    Chain<T>& ch = chains[c];
+                    ch.x.assign(n, T(0)); ch.grad.resize(n); ch.star.resize(n); ch.g_star.resize(n);
+                    ch.rng = utils::Philox(static_cast<uint64_t>(p.seed), static_cast<uint64_t>(c));
                 }
-                calc_grad_LC(star, g_star, p.lambda, p.alpha, p.s, w, h);
-                double log_a = -calc_E_LC(star, p.lambda, p.alpha, p.s, w, h) + calc_E_LC(p_s, p.lambda, p.alpha, p.s, w, h) + calc_log_Q(p_s, star, g_star, inv_4eps_pri, p.epsilon_pri) - calc_log_Q(star, p_s, grad, inv_4eps_pri, p.epsilon_pri);
-                if (static_cast<double>(rand())/RAND_MAX <= exp(min(0.0, log_a))) p_s = star;
             }
-            for (int i = 0; i < n; ++i) {
-                exp_pri_sq += p_s[i] * p_s[i];
-                int x = i % w, y = i / w;
-                if (x < w - 1) exp_pri_lc += stable_log_cosh(p.s * (p_s[i] - p_s[i+1]));
-                if (y < h - 1) exp_pri_lc += stable_log_cosh(p.s * (p_s[i] - p_s[i+w]));
+        }
+
+    protected:
+        bool advance() override {
+            if (!p.is_learning) {
+                // 学習なし: MAP の 2 ステップずつ進め、変化が小さくなるか 100 回で終える
+                double inv_sigma_sq = 1.0 / utils::safe_denom(p.sigma_sq);
+                m_old = m;
+                for (int step = 0; step < 2; ++step) map_step(inv_sigma_sq);
+                double diff = 0;
+                for (int i = 0; i < n; ++i) diff += abs(m[i] - m_old[i]);
+                if ((diff / static_cast<double>(n)) >= 1e-3 && ++iter < 100) return false;
+                report(p.max_iter, 0.0, m, "CONVERGED", true);
+                return true;
             }
+            if (iter >= p.max_iter) return true;
+            ++iter;
+
+            double inv_sigma_sq = 1.0 / utils::safe_denom(p.sigma_sq);
+            double inv_2sigma_sq = 0.5 * inv_sigma_sq;
+            
+            // 1. MAP Optimization
+            for (int step = 0; step < 2; ++step) map_step(inv_sigma_sq);
+
+            // 2-3. Prior / Posterior Sampling (MALA)
+            // 連鎖は互いに独立なのでスレッドプールで並列に進める。persistent_chains のときは
+            // 前反復の最終状態から再開する (持続的コントラスティブ・ダイバージェンス)
+            int n_chains = p.n_pri + p.n_post;
+            double inv_4eps_pri = 1.0 / utils::safe_denom(4.0 * p.epsilon_pri);
+            double sqrt_2eps_pri = sqrt(2.0 * p.epsilon_pri);
+            double inv_4eps_post = 1.0 / utils::safe_denom(4.0 * p.epsilon_post);
+            double sqrt_2eps_post = sqrt(2.0 * p.epsilon_post);
+            pool().parallel_for(0, n_chains, [&](int c0, int c1) {
+                for (int c = c0; c < c1; ++c) {
+                    Chain<T>& ch = chains[c];
+                    bool prior = (c < p.n_pri);
+                    if (!ch.started || !p.persistent_chains) {
+                        if (prior) fill(ch.x.begin(), ch.x.end(), T(0));
+                        else ch.x.assign(m.begin(), m.end());
+                        ch.started = true;
+                    }
+                    double eps = prior ? p.epsilon_pri : p.epsilon_post;
+                    double sqrt_2eps = prior ? sqrt_2eps_pri : sqrt_2eps_post;
+                    double inv_4eps = prior ? inv_4eps_pri : inv_4eps_post;
+                    int t_max = prior ? p.t_hat_max : p.t_dot_max;
+                    const T* y_n = prior ? nullptr : observed().data();
+                    // パラメータは反復ごとに変わるので、キャッシュは連鎖の開始時に作り直す
+                    ch.cur = lc_energy_grad<true>(ch.x, y_n, ch.grad, p.lambda, p.alpha, p.s, inv_sigma_sq, w, h);
+                    double e_cur = ch.cur.energy(p.lambda, p.alpha, inv_2sigma_sq);
+                    for (int t = 0; t < t_max; ++t) {
+                        propose(ch, eps, sqrt_2eps);
+                        LCSums star_sums = lc_energy_grad<true>(ch.star, y_n, ch.g_star, p.lambda, p.alpha, p.s, inv_sigma_sq, w, h);
+                        double e_star = star_sums.energy(p.lambda, p.alpha, inv_2sigma_sq);
+                        double log_a = -e_star + e_cur + calc_log_Q(ch.x, ch.star, ch.g_star, inv_4eps, eps) - calc_log_Q(ch.star, ch.x, ch.grad, inv_4eps, eps);
+                        if (ch.rng.uniform() <= exp(min(0.0, log_a))) {
+                            swap(ch.x, ch.star); swap(ch.grad, ch.g_star);
+                            ch.cur = star_sums; e_cur = e_star;
+                        }
+                    }
+                }
+            });
+
+            // 連鎖番号順に集計するので結果はスレッド数に依存しない
+            double exp_pri_sq = 0, exp_pri_lc = 0;
+            double exp_post_sq = 0, exp_post_lc = 0, exp_post_mq = 0;
+            for (int c = 0; c < p.n_pri; ++c) { exp_pri_sq += chains[c].cur.sq; exp_pri_lc += chains[c].cur.lc; }
+            for (int c = p.n_pri; c < n_chains; ++c) { exp_post_sq += chains[c].cur.sq; exp_post_lc += chains[c].cur.lc; exp_post_mq += chains[c].cur.mq; }
+            exp_pri_sq /= p.n_pri; exp_pri_lc /= p.n_pri;
+            exp_post_sq /= p.n_post; exp_post_lc /= p.n_post; exp_post_mq /= p.n_post;
+
+            // 4. Parameter Learning (MLE)
+            double grad_l = (exp_post_sq - exp_pri_sq) * inv_2n;
+            double grad_a = (exp_post_lc - exp_pri_lc) * inv_2n;
+            double grad_s2 = exp_post_mq * (0.5 / (pow(p.sigma_sq, 2.0) * n)) - 0.5 * inv_sigma_sq;
+
+            if (isnan(grad_l) || isinf(grad_l)) grad_l = 0.0;
+            if (isnan(grad_a) || isinf(grad_a)) grad_a = 0.0;
+            if (isnan(grad_s2) || isinf(grad_s2)) grad_s2 = 0.0;
+
+            p.lambda = max(1e-18, p.lambda + p.eta_lambda * grad_l);
+            p.alpha = max(1e-18, p.alpha + p.eta_alpha * grad_a);
+            p.sigma_sq = max(0.1, p.sigma_sq + p.eta_sigma2 * grad_s2);
+
+            // 報告は 1イテレーションにつき1回
+            double energy = lc_energy_grad<true>(m, centered_noisy.data(), grad, p.lambda, p.alpha, p.s, inv_sigma_sq, w, h).energy(p.lambda, p.alpha, inv_2sigma_sq);
+            report(iter, energy, m, "ESTIMATION DONE", iter == p.max_iter);
+            return iter >= p.max_iter;
         }
-        exp_pri_sq /= p.n_pri; exp_pri_lc /= p.n_pri;
-
-        // 3. Posterior Sampling (MALA)
-        double inv_4eps_post = 1.0 / utils::safe_denom(4.0 * p.epsilon_post);
-        double sqrt_2eps_post = sqrt(2.0 * p.epsilon_post);
-        for (int mu = 0; mu < p.n_post; ++mu) {
-            q_s = m;
-            for (int t = 0; t < p.t_dot_max; ++t) {
-                calc_grad_post(q_s, centered_noisy, grad, p.lambda, p.alpha, inv_sigma_sq, p.s, w, h);
-                for (int i = 0; i < n; ++i) {
-                    double r = sqrt(-2.0 * log((rand()+1.0)/(RAND_MAX+2.0))) * cos(2.0*M_PI*(rand()+1.0)/(RAND_MAX+2.0));
-                    star[i] = q_s[i] - p.epsilon_post * grad[i] + sqrt_2eps_post * r;
+
+    private:
+        // 提案 x* = x - ε∇E + √(2ε)·ξ。正規乱数は偶数個ずつのブロックで生成する
+        // (Philox の出力は生成の区切り方に依らないので、一度に n 個作るのと同じ列になる)
+        void propose(Chain<T>& ch, double eps, double sqrt_2eps) {
+            constexpr int kBlock = 4096;
+            thread_local vector<double> noise(kBlock);
+            for (int i0 = 0; i0 < n; i0 += kBlock) {
+                int count = min(kBlock, n - i0);
+                ch.rng.fill_normal(noise.data(), count);
+                for (int k = 0; k < count; ++k) {
+                    int i = i0 + k;
+                    ch.star[i] = static_cast<T>(ch.x[i] - eps * ch.grad[i] + sqrt_2eps * noise[k]);
                 }
-                calc_grad_post(star, g_star, centered_noisy, p.lambda, p.alpha, inv_sigma_sq, p.s, w, h);
-                double log_aq = -calc_E_post(star, centered_noisy, p.lambda, p.alpha, inv_2sigma_sq, p.s, w, h) + calc_E_post(q_s, centered_noisy, p.lambda, p.alpha, inv_2sigma_sq, p.s, w, h) + calc_log_Q(q_s, star, g_star, inv_4eps_post, p.epsilon_post) - calc_log_Q(star, q_s, grad, inv_4eps_post, p.epsilon_post);
-                if (static_cast<double>(rand())/RAND_MAX <= exp(min(0.0, log_aq))) q_s = star;
-            }
-            for (int i = 0; i < n; ++i) {
-                exp_post_sq += q_s[i] * q_s[i];
-                exp_post_mq += pow(centered_noisy[i] - q_s[i], 2.0);
-                int x = i % w, y = i / w;
-                if (x < w - 1) exp_post_lc += stable_log_cosh(p.s * (q_s[i] - q_s[i+1]));
-                if (y < h - 1) exp_post_lc += stable_log_cosh(p.s * (q_s[i] - q_s[i+w]));
             }
         }
-        exp_post_sq /= p.n_post; exp_post_lc /= p.n_post; exp_post_mq /= p.n_post;
 
-        // 4. Parameter Learning (MLE)
-        double grad_l = (exp_post_sq - exp_pri_sq) * inv_2n;
-        double grad_a = (exp_post_lc - exp_pri_lc) * inv_2n;
-        double grad_s2 = exp_post_mq * (0.5 / (pow(p.sigma_sq, 2.0) * n)) - 0.5 * inv_sigma_sq;
+        // 事後分布の連鎖が参照する観測 (中心化済み)。単精度では float に丸めた複製を使う
+        const vector<T>& observed() const {
+            if constexpr (is_same<T, double>::value) return centered_noisy;
+            else return y_chain;
+        }
+
+        // MAP 推定の 1 ステップ
+        void map_step(double inv_sigma_sq) {
+            if (accel) {
+                accel->step(m, centered_noisy.data(), p.lambda, p.alpha, p.s, inv_sigma_sq, w, h);
+                return;
+            }
+            lc_energy_grad<false>(m, centered_noisy.data(), grad, p.lambda, p.alpha, p.s, inv_sigma_sq, w, h);
+            for (int i = 0; i < n; ++i) m[i] -= p.epsilon_map * grad[i];
+        }
 
-        if (isnan(grad_l) || isinf(grad_l)) grad_l = 0.0;
-        if (isnan(grad_a) || isinf(grad_a)) grad_a = 0.0;
-        if (isnan(grad_s2) || isinf(grad_s2)) grad_s2 = 0.0;
+        LearnedParams params() const override { return {p.lambda, p.alpha, p.sigma_sq, 0.0}; }
 
-        p.lambda = max(1e-18, p.lambda + p.eta_lambda * grad_l);
-        p.alpha = max(1e-18, p.alpha + p.eta_alpha * grad_a);
-        p.sigma_sq = max(0.1, p.sigma_sq + p.eta_sigma2 * grad_s2);
+        LCMRFParams p;
+        vector<double> centered_noisy, m, m_old, grad;
+        vector<T> y_chain;
+        double inv_n = 0, inv_2n = 0;
+        unique_ptr<AcceleratedMAP> accel;
+        vector<Chain<T>> chains;
+        int iter = 0;
+    };
+}
 
-        // 報告は 1イテレーションにつき1回
-        report_progress(iter, calc_E_post(m, centered_noisy, p.lambda, p.alpha, inv_2sigma_sq, p.s, w, h), m, y_ave, "ESTIMATION DONE", on_step);
+namespace {
+    unique_ptr<Solver> make_lc_solver(DenoiseEngine& engine, const LCMRFParams& p, Solver::Callback cb) {
+        if (p.precision == PRECISION_MIXED) return make_unique<LCMRFSolver<float>>(engine, p, std::move(cb));
+        return make_unique<LCMRFSolver<double>>(engine, p, std::move(cb));
     }
 }
+
+void DenoiseEngine::lc_mrf(const LCMRFParams& p, function<void(const IterationResult&)> on_step) {
+    make_lc_solver(*this, p, std::move(on_step))->run();
+}
+
+void DenoiseEngine::start_lc_mrf(const LCMRFParams& p, function<void(const IterationResult&)> on_step) {
+    cancel();
+    active_solver = make_lc_solver(*this, p, std::move(on_step));
+}
@@ -0,0 +1,24 @@
+#include "solver.hpp"
+#include <chrono>
+
+Solver::Solver(DenoiseEngine& engine, Callback on_step)
+    : engine(engine), on_step(std::move(on_step)), w(engine.w), h(engine.h), n(engine.n) {}
+
+StepStatus Solver::step(double budget_ms) {
+    if (done) return STEP_DONE;
+    auto start = std::chrono::steady_clock::now();
+    do {
+        done = advance();
+    } while (!done && std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() < budget_ms);
+    if (done) finish();
+    return done ? STEP_DONE : STEP_RUNNING;
+}
+
+void Solver::run() {
+    while (!done) done = advance();
+    finish();
+}
+
+void Solver::finish() {
+    engine.learned = params();
+}
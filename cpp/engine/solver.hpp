@@ -0,0 +1,70 @@
+#ifndef SOLVER_HPP
+#define SOLVER_HPP
+
+#include <vector>
+#include <string>
+#include <functional>
+#include "denoise_engine.hpp"
+
+// 再開可能なソルバの基底
+// モデルごとの派生クラスが作業領域と反復の状態を保持し、step が呼ばれるたびに反復単位で先へ進める。
+// 開始時の処理 (中心化と INITIALIZING の報告) はコンストラクタで行う
+class Solver {
+public:
+    using Callback = std::function<void(const IterationResult&)>;
+    virtual ~Solver() = default;
+    Solver(const Solver&) = delete;
+    Solver& operator=(const Solver&) = delete;
+
+    // 少なくとも 1 反復進め、その後は経過時間が budget_ms に達するか終了するまで続ける
+    StepStatus step(double budget_ms);
+    // 終了まで進める (ブロッキング API 用)
+    void run();
+    bool finished() const { return done; }
+
+protected:
+    Solver(DenoiseEngine& engine, Callback on_step);
+
+    // 1 反復分進める。終了したら true を返す
+    virtual bool advance() = 0;
+    // 現在のパラメータ (終了時にエンジンの learned_params へ写す)
+    virtual LearnedParams params() const = 0;
+
+    // エンジン内部へのアクセス (DenoiseEngine の friend は基底クラスだけ)
+    void prepare(std::vector<double>& centered_noisy) { y_ave = engine.prepare_work_data(centered_noisy); }
+    void report(int iter, double energy, const std::vector<double>& centered_x, const std::string& task, bool force = false) {
+        engine.report_progress(iter, energy, centered_x, y_ave, task, on_step, force);
+    }
+    // 単精度の作業領域は double に広げてから報告する
+    void report(int iter, double energy, const std::vector<float>& centered_x, const std::string& task, bool force = false) {
+        widened.assign(centered_x.begin(), centered_x.end());
+        report(iter, energy, widened, task, force);
+    }
+    const std::vector<double>& eigenvalues() { return engine.eigenvalues(); }
+    // 固有値に関する和 Σ_i f(φ_i) を f(値, 重複度) で評価する。要約がなければ画素ごとにたどる
+    template <class F>
+    void for_each_eigenvalue(F f) {
+        if (const utils::Spectrum* spec = engine.spectrum()) {
+            spec->for_each(f);
+            return;
+        }
+        for (double phi : eigenvalues()) f(phi, 1.0);
+    }
+    utils::DCT2D& dct() { return engine.dct(); }
+    utils::Multigrid& multigrid() { return engine.multigrid(); }
+    utils::ThreadPool& pool() { return engine.pool(); }
+    const std::vector<double>& original() const { return engine.original_data; }
+
+    DenoiseEngine& engine;
+    Callback on_step;
+    int w, h, n;
+    double y_ave = 0.0;
+
+private:
+    void finish();
+
+    bool done = false;
+    std::vector<double> widened;
+};
+
+#endif
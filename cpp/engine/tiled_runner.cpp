@@ -0,0 +1,172 @@
+#include "tiled_runner.hpp"
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    // 画素値の整数和 (順序に依らず厳密に積算できる)
+    struct QualitySums {
+        uint64_t a = 0, b = 0, aa = 0, bb = 0, ab = 0, sq_err = 0;
+        QualitySums& operator+=(const QualitySums& o) {
+            a += o.a; b += o.b; aa += o.aa; bb += o.bb; ab += o.ab; sq_err += o.sq_err;
+            return *this;
+        }
+    };
+
+    // 帯 1 本分のタイルを並列に解く。noisy/original は上下の halo を含む帯 (band_y0 行目から)、
+    // out はコア行 (core_y0 行目から core_h 行) を指すビュー。タイルの入力はビューの部分領域から直接取り込む
+    void solve_band(const utils::ImageView& noisy, const utils::ImageView* original, const utils::MutableImageView& out,
+                    int band_y0, int core_y0, int tile, int halo, const TileSolve& solve,
+                    utils::TaskScheduler& scheduler, QualitySums& total) {
+        int width = noisy.width, band_h = noisy.height, core_h = out.height;
+        int tiles_x = (width + tile - 1) / tile;
+        vector<QualitySums> tile_sums(tiles_x);
+
+        // ジョブの例外は帯の終わりに呼び出し側へ投げ直す
+        mutex mtx;
+        condition_variable cv;
+        int pending = tiles_x;
+        exception_ptr error;
+        for (int tx = 0; tx < tiles_x; ++tx) {
+            scheduler.submit([&, tx] {
+                try {
+                    int core_x0 = tx * tile, core_w = min(tile, width - core_x0);
+                    int x0 = max(0, core_x0 - halo), x1 = min(width, core_x0 + core_w + halo);
+                    int tw = x1 - x0;
+                    utils::ImageView tile_noisy = noisy.sub(x0, 0, tw, band_h);
+
+                    DenoiseEngine engine(tw, band_h);
+                    engine.set_num_threads(1); // 並列性はタイル単位で取る
+                    ProgressPolicy policy;
+                    policy.every_k = 1 << 30;
+                    policy.compute_metrics = false;
+                    engine.set_progress_policy(policy);
+                    engine.set_input(original ? original->sub(x0, 0, tw, band_h) : tile_noisy, tile_noisy);
+                    solve(engine);
+                    vector<uint8_t> result(static_cast<size_t>(tw) * band_h);
+                    engine.get_output(result.data());
+
+                    // コア領域だけを書き戻す
+                    QualitySums s;
+                    for (int y = 0; y < core_h; ++y) {
+                        int by = y + core_y0 - band_y0;
+                        const uint8_t* src = &result[static_cast<size_t>(by) * tw + (core_x0 - x0)];
+                        uint8_t* dst = out.row(y) + core_x0;
+                        copy_n(src, core_w, dst);
+                        if (!original) continue;
+                        const uint8_t* ref = original->row(by) + core_x0;
+                        for (int x = 0; x < core_w; ++x) {
+                            uint64_t a = ref[x], b = dst[x];
+                            int64_t d = static_cast<int64_t>(a) - static_cast<int64_t>(b);
+                            s.a += a; s.b += b; s.aa += a * a; s.bb += b * b; s.ab += a * b;
+                            s.sq_err += static_cast<uint64_t>(d * d);
+                        }
+                    }
+                    tile_sums[tx] = s;
+                } catch (...) {
+                    lock_guard<mutex> lock(mtx);
+                    if (!error) error = current_exception();
+                }
+                lock_guard<mutex> lock(mtx);
+                if (--pending == 0) cv.notify_one();
+            });
+        }
+        {
+            unique_lock<mutex> lock(mtx);
+            cv.wait(lock, [&] { return pending == 0; });
+        }
+        if (error) rethrow_exception(error);
+        for (const QualitySums& s : tile_sums) total += s;
+    }
+
+    // 帯の分割を順にたどる
+    template <class Band>
+    TiledResult for_each_band(int width, int height, const TileConfig& cfg, bool has_original, Band&& band) {
+        if (width <= 0 || height <= 0) throw runtime_error("run_tiled: invalid image size");
+        int tile = max(1, cfg.tile), halo = max(0, cfg.halo);
+        TiledResult result;
+        QualitySums total;
+        for (int core_y0 = 0; core_y0 < height; core_y0 += tile) {
+            int core_h = min(tile, height - core_y0);
+            int band_y0 = max(0, core_y0 - halo), band_y1 = min(height, core_y0 + core_h + halo);
+            band(band_y0, band_y1 - band_y0, core_y0, core_h, tile, halo, total);
+            result.tiles += (width + tile - 1) / tile;
+        }
+        if (has_original) {
+            double n = static_cast<double>(width) * height;
+            double mse = static_cast<double>(total.sq_err) / n;
+            result.psnr = (mse < 1e-10) ? 100.0 : 10.0 * log10(255.0 * 255.0 / mse);
+
+            double c1 = 6.5025, c2 = 58.5225;
+            double m1 = total.a / n, m2 = total.b / n;
+            double s1 = (static_cast<double>(total.aa) - n * m1 * m1) / (n - 1);
+            double s2 = (static_cast<double>(total.bb) - n * m2 * m2) / (n - 1);
+            double s12 = (static_cast<double>(total.ab) - n * m1 * m2) / (n - 1);
+            result.ssim = ((2 * m1 * m2 + c1) * (2 * s12 + c2)) / ((m1 * m1 + m2 * m2 + c1) * (s1 + s2 + c2));
+        }
+        return result;
+    }
+}
+
+LearnedParams learn_tile_params(int width, int height, const TileConfig& cfg, bool has_original,
+                                const TileReadRows& read_rows, const TileSolve& solve) {
+    if (width <= 0 || height <= 0) throw runtime_error("learn_tile_params: invalid image size");
+    int side = max(1, cfg.tile) + 2 * max(0, cfg.halo);
+    int ww = min(width, side), wh = min(height, side);
+    int x0 = (width - ww) / 2, y0 = (height - wh) / 2;
+    size_t row_bytes = static_cast<size_t>(width);
+    vector<uint8_t> band_noisy(row_bytes * wh), band_original(has_original ? row_bytes * wh : 0);
+    read_rows(y0, wh, band_noisy.data(), has_original ? band_original.data() : nullptr);
+    utils::ImageView noisy = utils::contiguous_view(static_cast<const uint8_t*>(band_noisy.data()), width, wh).sub(x0, 0, ww, wh);
+    utils::ImageView original = has_original
+        ? utils::contiguous_view(static_cast<const uint8_t*>(band_original.data()), width, wh).sub(x0, 0, ww, wh) : noisy;
+
+    DenoiseEngine engine(ww, wh);
+    ProgressPolicy policy;
+    policy.every_k = 1 << 30;
+    policy.compute_metrics = false;
+    engine.set_progress_policy(policy);
+    engine.set_input(original, noisy);
+    solve(engine);
+    return engine.learned_params();
+}
+
+TiledResult run_tiled(int width, int height, const TileConfig& cfg, bool has_original,
+                      const TileReadRows& read_rows, const TileWriteRows& write_rows,
+                      const TileSolve& solve, utils::TaskScheduler& scheduler) {
+    vector<uint8_t> band_noisy, band_original, band_out;
+    return for_each_band(width, height, cfg, has_original,
+        [&](int band_y0, int band_h, int core_y0, int core_h, int tile, int halo, QualitySums& total) {
+            size_t row_bytes = static_cast<size_t>(width);
+            band_noisy.resize(row_bytes * band_h);
+            band_original.resize(has_original ? row_bytes * band_h : 0);
+            band_out.resize(row_bytes * core_h);
+            read_rows(band_y0, band_h, band_noisy.data(), has_original ? band_original.data() : nullptr);
+            utils::ImageView noisy = utils::contiguous_view(static_cast<const uint8_t*>(band_noisy.data()), width, band_h);
+            utils::ImageView original = utils::contiguous_view(static_cast<const uint8_t*>(band_original.data()), width, band_h);
+            solve_band(noisy, has_original ? &original : nullptr, utils::contiguous_view(band_out.data(), width, core_h),
+                       band_y0, core_y0, tile, halo, solve, scheduler, total);
+            write_rows(core_y0, core_h, band_out.data());
+        });
+}
+
+TiledResult run_tiled(const utils::ImageView& noisy, const utils::ImageView* original, const utils::MutableImageView& out,
+                      const TileConfig& cfg, const TileSolve& solve, utils::TaskScheduler& scheduler) {
+    if ((original && (original->width != noisy.width || original->height != noisy.height)) ||
+        out.width != noisy.width || out.height != noisy.height) {
+        throw invalid_argument("run_tiled: view sizes do not match");
+    }
+    return for_each_band(noisy.width, noisy.height, cfg, original != nullptr,
+        [&](int band_y0, int band_h, int core_y0, int core_h, int tile, int halo, QualitySums& total) {
+            utils::ImageView band_original;
+            if (original) band_original = original->sub(0, band_y0, original->width, band_h);
+            solve_band(noisy.sub(0, band_y0, noisy.width, band_h), original ? &band_original : nullptr,
+                       out.sub(0, core_y0, out.width, core_h), band_y0, core_y0, tile, halo, solve, scheduler, total);
+        });
+}
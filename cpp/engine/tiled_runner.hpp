@@ -0,0 +1,51 @@
+#ifndef TILED_RUNNER_HPP
+#define TILED_RUNNER_HPP
+
+#include <cstdint>
+#include <functional>
+#include "denoise_engine.hpp"
+#include "../utils/task_scheduler.hpp"
+
+// 全画面を持たずに巨大な画像を復元するタイル実行 (ネイティブビルドのみ)
+//
+// 画像を tile x tile のコア領域に分け、周囲 halo 画素の重なりを付けたタイルごとに DenoiseEngine を
+// 1 つ作って独立に解き、コア領域だけを書き戻す。MRF の解は境界の影響が数画素で減衰するので、
+// halo を拡散長より十分に広く取れば全画面で解いた結果とほぼ一致する。
+// 画素は tile 行分の帯 (上下の halo を含む) ずつ入力から読み、帯内のタイルをスケジューラで並列に解いて、
+// 帯が終わるたびに出力へ流す。メモリは画像サイズではなく (tile + 2·halo)² とワーカー数で決まる
+// (ビュー版ではメモリマップの触れたページだけが常駐し、OS が必要に応じて捨てる)。
+//
+// 学習ありの設定をそのままタイルに渡すとタイルごとに異なるパラメータで復元され、コア領域の境界に継ぎ目が出る
+// (halo では防げない)。learn_tile_params で一度だけ学習し、全タイルを同じ値の学習なしで解くこと。
+// 全画面の指標は 8 bit 出力と原画像から整数の和で積算する (QualityAccumulator と同じ式)
+struct TileConfig {
+    int tile = 256; // コア領域の一辺
+    int halo = 32;  // 重なりの幅
+};
+
+struct TiledResult {
+    int tiles = 0;
+    double psnr = 0, ssim = 0; // 原画像を渡したときだけ有効
+};
+
+// 上端から y0 行目から count 行 (各 width バイト) を読む。original は原画像がなければ nullptr
+using TileReadRows = std::function<void(int y0, int count, uint8_t* noisy, uint8_t* original)>;
+using TileWriteRows = std::function<void(int y0, int count, const uint8_t* rows)>;
+// タイル 1 枚分のエンジンで復元を実行する (入力と報告設定は設定済み)
+using TileSolve = std::function<void(DenoiseEngine& engine)>;
+
+TiledResult run_tiled(int width, int height, const TileConfig& cfg, bool has_original,
+                      const TileReadRows& read_rows, const TileWriteRows& write_rows,
+                      const TileSolve& solve, utils::TaskScheduler& scheduler);
+
+// 画像中央の (tile + 2·halo) 四方の窓 (画像が小さければ全体) で solve を 1 回実行し、推定されたパラメータを返す。
+// 窓は画素の尺度と雑音の統計を保つので、縮小画像と違って推定値をそのまま全画面に使える
+LearnedParams learn_tile_params(int width, int height, const TileConfig& cfg, bool has_original,
+                                const TileReadRows& read_rows, const TileSolve& solve);
+
+// ビュー (メモリマップしたファイルなど) を直接読み書きする版。帯の複製を作らず、タイルは入力ビューの
+// 部分領域から取り込んでコア領域を out へ書く。original は原画像がなければ nullptr
+TiledResult run_tiled(const utils::ImageView& noisy, const utils::ImageView* original, const utils::MutableImageView& out,
+                      const TileConfig& cfg, const TileSolve& solve, utils::TaskScheduler& scheduler);
+
+#endif
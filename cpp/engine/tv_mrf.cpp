@@ -1,75 +1,237 @@
 #include "denoise_engine.hpp"
+#include "solver.hpp"
 #include "../utils/core.hpp"
 #include "../utils/numeric_guard.hpp"
+#include "../utils/stencil.hpp"
+#include "../utils/reduction.hpp"
+#include "../utils/simd.hpp"
 #include <cmath>
 #include <vector>
 #include <numeric>
 #include <algorithm>
+#include <memory>
 
-void DenoiseEngine::rtv_mrf(const RTVMRFParams& p_in, std::function<void(const IterationResult&)> on_step) {
-    RTVMRFParams p = p_in;
-    double mu = p.alpha;
-    double lambda_reg = 1.0; 
-    double conv_epsilon = 1.0e-3;
+namespace {
+    // split-Bregman 法 (x-step は solver で選ぶ)
+    class RTVSplitBregmanSolver : public Solver {
+    public:
+        RTVSplitBregmanSolver(DenoiseEngine& engine, const RTVMRFParams& p_in, Callback cb) : Solver(engine, std::move(cb)), p(p_in) {
+            mu = p.alpha;
+            prepare(centered_noisy);
+            x_vec = centered_noisy;
+            d_x.assign(n, 0.0); d_y.assign(n, 0.0); b_x.assign(n, 0.0); b_y.assign(n, 0.0);
+            rhs.resize(n);
+            x_old = x_vec;
 
-    std::vector<double> centered_noisy;
-    double y_ave = prepare_work_data(centered_noisy);
-    std::vector<double> x_vec = centered_noisy;
-    std::vector<double> d_x(n, 0.0), d_y(n, 0.0), b_x(n, 0.0), b_y(n, 0.0);
+            report(0, 0.0, x_vec, "INITIALIZING", true);
+        }
 
-    report_progress(0, 0.0, x_vec, y_ave, "INITIALIZING", on_step);
+    protected:
+        bool advance() override {
+            if (iter >= p.max_iter) return true;
+            ++iter;
 
-    for (int iter = 1; iter <= p.max_iter; ++iter) {
-        std::vector<double> x_old = x_vec;
-        
-        // 1. x-step (MAP Optimization)
-        for (int step = 0; step < 2; ++step) {
+            // 1. x-step (MAP Optimization)
+            // (λ + 1/σ² + λ_reg L) x = y/σ² + λ_reg ∇^T(d - b)。右辺は x-step の間は一定
+            double inv_sigma_sq = 1.0 / utils::safe_denom(p.sigma_sq);
             for (int y = 0; y < h; ++y) {
                 for (int x = 0; x < w; ++x) {
                     int i = get_idx(x, y);
-                    double nx = 0; int count = 0;
-                    if (x > 0) { nx += x_vec[get_idx(x-1, y)] - d_x[get_idx(x-1, y)] + b_x[get_idx(x-1, y)]; count++; }
-                    if (x < w - 1) { nx += x_vec[get_idx(x+1, y)] + d_x[i] - b_x[i]; count++; }
-                    if (y > 0) { nx += x_vec[get_idx(x, y-1)] - d_y[get_idx(x, y-1)] + b_y[get_idx(x, y-1)]; count++; }
-                    if (y < h - 1) { nx += x_vec[get_idx(x, y+1)] + d_y[i] - b_y[i]; count++; }
-                    double denom = p.lambda + 1.0/utils::safe_denom(p.sigma_sq) + count * lambda_reg;
-                    x_vec[i] = (centered_noisy[i]/utils::safe_denom(p.sigma_sq) + lambda_reg * nx) / utils::safe_denom(denom);
+                    double nd = 0;
+                    if (x > 0) nd += -d_x[get_idx(x-1, y)] + b_x[get_idx(x-1, y)];
+                    if (x < w - 1) nd += d_x[i] - b_x[i];
+                    if (y > 0) nd += -d_y[get_idx(x, y-1)] + b_y[get_idx(x, y-1)];
+                    if (y < h - 1) nd += d_y[i] - b_y[i];
+                    rhs[i] = centered_noisy[i] * inv_sigma_sq + lambda_reg * nd;
+                }
+            }
+            if (p.solver == SOLVER_SPECTRAL) {
+                // DCT で対角化して厳密に解く: x̂_k = r̂_k / (λ + 1/σ² + λ_reg φ_k)
+                const std::vector<double>& phi = eigenvalues();
+                dct().forward(rhs, rhs_hat);
+                for (int i = 0; i < n; ++i) rhs_hat[i] /= utils::safe_denom(p.lambda + inv_sigma_sq + lambda_reg * phi[i]);
+                dct().inverse(rhs_hat, x_vec);
+            } else if (p.solver == SOLVER_MULTIGRID) {
+                multigrid().solve(p.lambda + inv_sigma_sq, lambda_reg, rhs, x_vec);
+            } else {
+                utils::ScreenedPoisson op(p.lambda + inv_sigma_sq, lambda_reg);
+                for (int step = 0; step < 2; ++step) {
+                    if (p.solver == SOLVER_RED_BLACK) utils::sweep_red_black(op, x_vec, rhs, w, h, pool());
+                    else utils::sweep_lexicographic(op, x_vec, rhs, w, h);
                 }
             }
-        }
 
-        // 2. d-step (Shrinkage)
-        for (int y = 0; y < h; ++y) {
-            for (int x = 0; x < w; ++x) {
-                int i = get_idx(x, y);
-                if (x < w - 1) {
-                    double diff = x_vec[i] - x_vec[get_idx(x+1, y)] + b_x[i];
-                    double mag = std::abs(diff);
-                    d_x[i] = std::max(mag - mu/lambda_reg, 0.0) * (diff / utils::safe_denom(mag));
+            // 2-3. d-step (Shrinkage) と b-step (Bregman Update) を行ごとに続けて行う 1 パス
+            // (b の更新は同じ辺の d だけに依存するので融合しても結果は変わらない)。MAE も同時に集計する
+            double thresh = mu / lambda_reg;
+            // 辺 count 本分の d = shrink(∇x + b), b += ∇x - d を 2 辺ずつ SIMD で計算する (端数は片方のレーンだけ使う)
+            auto shrink_row = [thresh](const double* xa, const double* xb, double* d, double* b, int count) {
+                using namespace utils::simd;
+                const f64x2 vt = splat(thresh), zero = splat(0.0), eps = splat(utils::EPSILON);
+                auto update = [&](f64x2 grad, f64x2 bv, f64x2& dv) {
+                    f64x2 v = grad + bv;
+                    f64x2 mag = abs(v);
+                    dv = max(mag - vt, zero) * (v / max(mag, eps));
+                    return bv + (grad - dv);
+                };
+                f64x2 dv;
+                int k = 0;
+                for (; k + 1 < count; k += 2) {
+                    store(b + k, update(load(xa + k) - load(xb + k), load(b + k), dv));
+                    store(d + k, dv);
                 }
-                if (y < h - 1) {
-                    double diff = x_vec[i] - x_vec[get_idx(x, y+1)] + b_y[i];
-                    double mag = std::abs(diff);
-                    d_y[i] = std::max(mag - mu/lambda_reg, 0.0) * (diff / utils::safe_denom(mag));
+                if (k < count) {
+                    b[k] = lane0(update(splat(xa[k] - xb[k]), splat(b[k]), dv));
+                    d[k] = lane0(dv);
                 }
+            };
+            double mae = utils::reduce_rows(pool(), h, row_mae, [&](int y, double& acc) {
+                using namespace utils::simd;
+                int row = y * w;
+                const double* xr = x_vec.data() + row;
+                shrink_row(xr, xr + 1, d_x.data() + row, b_x.data() + row, w - 1);
+                if (y < h - 1) shrink_row(xr, xr + w, d_y.data() + row, b_y.data() + row, w);
+                double* xo = x_old.data() + row;
+                f64x2 sum = splat(0.0);
+                int x = 0;
+                for (; x + 1 < w; x += 2) {
+                    f64x2 v = load(xr + x);
+                    sum += abs(v - load(xo + x));
+                    store(xo + x, v);
+                }
+                acc += hsum(sum);
+                for (; x < w; ++x) {
+                    acc += std::abs(xr[x] - xo[x]);
+                    xo[x] = xr[x];
+                }
+            });
+
+            report(iter, 0.0, x_vec, "OPTIMIZING", iter == p.max_iter);
+
+            if ((mae / n) < conv_epsilon) {
+                report(iter, 0.0, x_vec, "CONVERGED", true);
+                return true;
             }
+            return iter >= p.max_iter;
         }
 
-        // 3. b-step (Bregman Update)
-        for (int i = 0; i < n; ++i) {
-            int x = i % w, y = i / w;
-            if (x < w - 1) b_x[i] += (x_vec[i] - x_vec[get_idx(x+1, y)] - d_x[i]);
-            if (y < h - 1) b_y[i] += (x_vec[i] - x_vec[get_idx(x, y+1)] - d_y[i]);
+    private:
+        int get_idx(int x, int y) const { return y * w + x; }
+
+        LearnedParams params() const override { return {p.lambda, p.alpha, p.sigma_sq, 0.0}; }
+
+        RTVMRFParams p;
+        double mu = 0.0;
+        const double lambda_reg = 1.0;
+        const double conv_epsilon = 1.0e-3;
+        std::vector<double> centered_noisy, x_vec, d_x, d_y, b_x, b_y, rhs, x_old, rhs_hat;
+        std::vector<double> row_mae;
+        int iter = 0;
+    };
+
+    // Chambolle-Pock 主双対法 (強凸な G に対する加速版, CP 2011 Algorithm 2)
+    //   min_x G(x) + μ Σ (|∇_x x| + |∇_y x|),  G(x) = |x - y|²/(2σ²) + λ|x|²/2
+    // 双対変数 p は |p| ≤ μ の箱への射影、主変数は G の近接写像で閉じた形に更新できる。
+    // どちらの更新も全画素独立なので、行バンドごとにスレッド並列で実行しても結果は変わらない
+    class RTVPrimalDualSolver : public Solver {
+    public:
+        RTVPrimalDualSolver(DenoiseEngine& engine, const RTVMRFParams& p_in, Callback cb) : Solver(engine, std::move(cb)), p(p_in) {
+            mu = p.alpha;
+            prepare(centered_noisy);
+            x_vec = centered_noisy; x_bar = centered_noisy; x_old = centered_noisy;
+            p_x.assign(n, 0.0); p_y.assign(n, 0.0); zero_row.assign(w, 0.0);
+
+            report(0, 0.0, x_vec, "INITIALIZING", true);
+
+            inv_sigma_sq = 1.0 / utils::safe_denom(p.sigma_sq);
+            gamma = inv_sigma_sq + p.lambda; // G の強凸性の係数
         }
 
-        double mae = 0;
-        for (int i = 0; i < n; ++i) mae += std::abs(x_vec[i] - x_old[i]);
+    protected:
+        bool advance() override {
+            if (iter >= p.max_iter) return true;
+            ++iter;
 
-        report_progress(iter, 0.0, x_vec, y_ave, "OPTIMIZING", on_step);
+            for (int step = 0; step < steps_per_report; ++step) {
+                // 双対: p ← clip(p + σ ∇x̄, -μ, μ)  (前進差分、右端列/下端行は 0 のまま)
+                pool().parallel_for(0, h, [&](int y0, int y1) {
+                    for (int y = y0; y < y1; ++y) {
+                        int row = y * w;
+                        for (int i = row; i < row + w - 1; ++i) {
+                            p_x[i] = std::min(mu, std::max(-mu, p_x[i] + sigma_d * (x_bar[i + 1] - x_bar[i])));
+                        }
+                        if (y < h - 1) {
+                            for (int i = row; i < row + w; ++i) {
+                                p_y[i] = std::min(mu, std::max(-mu, p_y[i] + sigma_d * (x_bar[i + w] - x_bar[i])));
+                            }
+                        }
+                    }
+                });
 
-        if ((mae / n) < conv_epsilon) {
-            report_progress(iter, 0.0, x_vec, y_ave, "CONVERGED", on_step);
-            break;
+                // 主: x ← prox_τG(x + τ div p) = (x̃ + τy/σ²) / (1 + τγ)
+                double theta = 1.0 / std::sqrt(1.0 + 2.0 * gamma * tau);
+                double scale = 1.0 / (1.0 + tau * gamma), tau_y = tau * inv_sigma_sq;
+                pool().parallel_for(0, h, [&](int y0, int y1) {
+                    for (int y = y0; y < y1; ++y) {
+                        int row = y * w;
+                        // 上端行は上の辺がないので 0 の行を参照させ、内側のループから分岐をなくす
+                        const double* py_up = (y > 0) ? &p_y[row - w] : zero_row.data();
+                        auto update = [&](int x, double px_left) {
+                            int i = row + x;
+                            double div = p_x[i] - px_left + p_y[i] - py_up[x];
+                            double x_new = (x_vec[i] + tau * div + tau_y * centered_noisy[i]) * scale;
+                            x_bar[i] = x_new + theta * (x_new - x_vec[i]);
+                            x_vec[i] = x_new;
+                        };
+                        update(0, 0.0);
+                        for (int x = 1; x < w; ++x) update(x, p_x[row + x - 1]);
+                    }
+                });
+                tau *= theta;
+                sigma_d /= theta;
+            }
+
+            double mae = utils::reduce_rows(pool(), h, row_mae, [&](int y, double& acc) {
+                for (int i = y * w; i < (y + 1) * w; ++i) {
+                    acc += std::abs(x_vec[i] - x_old[i]);
+                    x_old[i] = x_vec[i];
+                }
+            });
+
+            report(iter, 0.0, x_vec, "OPTIMIZING", iter == p.max_iter);
+
+            if ((mae / n) < conv_epsilon) {
+                report(iter, 0.0, x_vec, "CONVERGED", true);
+                return true;
+            }
+            return iter >= p.max_iter;
         }
+
+    private:
+        LearnedParams params() const override { return {p.lambda, p.alpha, p.sigma_sq, 0.0}; }
+
+        RTVMRFParams p;
+        double mu = 0.0;
+        const double conv_epsilon = 1.0e-3;
+        const int steps_per_report = 10; // 1 反復が軽いので 10 ステップごとに報告する
+        std::vector<double> centered_noisy, x_vec, x_bar, x_old, p_x, p_y, zero_row;
+        std::vector<double> row_mae;
+        double inv_sigma_sq = 0.0, gamma = 0.0;
+        double tau = 1.0 / std::sqrt(8.0), sigma_d = 1.0 / std::sqrt(8.0); // τσ|∇|² ≤ 1 (|∇|² ≤ 8)
+        int iter = 0;
+    };
+
+    std::unique_ptr<Solver> make_rtv_solver(DenoiseEngine& engine, const RTVMRFParams& p, std::function<void(const IterationResult&)> on_step) {
+        if (p.tv_solver == TV_PRIMAL_DUAL) return std::make_unique<RTVPrimalDualSolver>(engine, p, std::move(on_step));
+        return std::make_unique<RTVSplitBregmanSolver>(engine, p, std::move(on_step));
     }
 }
+
+void DenoiseEngine::rtv_mrf(const RTVMRFParams& p, std::function<void(const IterationResult&)> on_step) {
+    make_rtv_solver(*this, p, std::move(on_step))->run();
+}
+
+void DenoiseEngine::start_rtv_mrf(const RTVMRFParams& p, std::function<void(const IterationResult&)> on_step) {
+    cancel();
+    active_solver = make_rtv_solver(*this, p, std::move(on_step));
+}
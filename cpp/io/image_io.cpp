@@ -0,0 +1,199 @@
+#include "image_io.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <stdexcept>
+
+namespace io {
+
+namespace {
+
+uint16_t read_u16(const uint8_t* b) {
+    return static_cast<uint16_t>(b[0] | (b[1] << 8));
+}
+
+uint32_t read_u32(const uint8_t* b) {
+    return static_cast<uint32_t>(b[0]) | (static_cast<uint32_t>(b[1]) << 8) |
+           (static_cast<uint32_t>(b[2]) << 16) | (static_cast<uint32_t>(b[3]) << 24);
+}
+
+void put_u16(uint8_t*& b, uint16_t v) {
+    *b++ = v & 0xFF; *b++ = v >> 8;
+}
+
+void put_u32(uint8_t*& b, uint32_t v) {
+    for (int k = 0; k < 4; ++k) *b++ = (v >> (8 * k)) & 0xFF;
+}
+
+uint8_t luma(uint8_t r, uint8_t g, uint8_t b) {
+    return static_cast<uint8_t>(std::lround(0.299 * r + 0.587 * g + 0.114 * b));
+}
+
+bool has_extension(const std::string& path, const char* ext) {
+    std::string e(ext);
+    if (path.size() < e.size()) return false;
+    std::string tail = path.substr(path.size() - e.size());
+    std::transform(tail.begin(), tail.end(), tail.begin(), [](unsigned char c) { return std::tolower(c); });
+    return tail == e;
+}
+
+} // namespace
+
+ImageReader::ImageReader(const std::string& path_in, RawSize raw) : path(path_in), file(MappedFile::open_read(path_in)) {
+    const uint8_t* b = file.data();
+    size_t size = file.size();
+    for (int v = 0; v < 256; ++v) gray_of[v] = static_cast<uint8_t>(v);
+    if (has_extension(path, ".raw")) {
+        if (raw.width <= 0 || raw.height <= 0) throw std::runtime_error(path + ": raw input needs an explicit size");
+        if (static_cast<uint64_t>(raw.width) * raw.height > size) throw std::runtime_error(path + ": truncated raw pixel data");
+        w = raw.width; h = raw.height;
+        pixels = utils::contiguous_view(b, w, h);
+    } else if (size >= 2 && b[0] == 'B' && b[1] == 'M') {
+        open_bmp();
+    } else if (size >= 2 && b[0] == 'P' && (b[1] == '5' || b[1] == '2')) {
+        open_pgm(b[1] == '2');
+    } else {
+        throw std::runtime_error(path + ": unknown image format (expected BMP, PGM or .raw)");
+    }
+}
+
+void ImageReader::open_bmp() {
+    const uint8_t* b = file.data();
+    if (file.size() < 54) throw std::runtime_error(path + ": truncated BMP header");
+    uint64_t data_offset = read_u32(b + 10);
+    uint32_t dib_size = read_u32(b + 14);
+    int32_t width = static_cast<int32_t>(read_u32(b + 18));
+    int32_t height = static_cast<int32_t>(read_u32(b + 22));
+    uint16_t bpp = read_u16(b + 28);
+    uint32_t compression = read_u32(b + 30);
+    uint32_t colors_used = read_u32(b + 46);
+    if (compression != 0 && !(compression == 3 && bpp == 32)) throw std::runtime_error(path + ": compressed BMP is not supported");
+    if (bpp != 8 && bpp != 24 && bpp != 32) throw std::runtime_error(path + ": unsupported BMP bit depth " + std::to_string(bpp));
+    bool top_down = height < 0;
+    if (top_down) height = -height;
+    if (width <= 0 || height <= 0) throw std::runtime_error(path + ": invalid BMP size");
+    w = width; h = height;
+    bytes_per_pixel = bpp / 8;
+    uint64_t stride = ((static_cast<uint64_t>(bpp) * w + 31) / 32) * 4;
+    if (data_offset + stride * h > file.size()) throw std::runtime_error(path + ": truncated BMP pixel data");
+
+    // 下端の行から並ぶ場合は最後の行を先頭とし、負のストライドで上へたどる
+    const uint8_t* first = b + data_offset + (top_down ? 0 : stride * (h - 1));
+    pixels = {first, w, h, top_down ? static_cast<std::ptrdiff_t>(stride) : -static_cast<std::ptrdiff_t>(stride)};
+
+    // 8 bit はパレットを輝度の表に変換しておく
+    if (bpp == 8) {
+        uint64_t palette = 14 + dib_size;
+        uint32_t count = colors_used ? std::min<uint32_t>(colors_used, 256) : 256;
+        if (palette + 4 * count > data_offset) throw std::runtime_error(path + ": truncated BMP palette");
+        std::fill(gray_of, gray_of + 256, 0);
+        for (uint32_t k = 0; k < count; ++k) {
+            const uint8_t* e = b + palette + 4 * k;
+            gray_of[k] = (e[0] == e[1] && e[1] == e[2]) ? e[0] : luma(e[2], e[1], e[0]);
+        }
+        identity = (count == 256); // 範囲外の番号は 0 に変換するので、256 色揃っているときだけ恒等になりうる
+        for (int k = 0; k < 256 && identity; ++k) identity = (gray_of[k] == k);
+    }
+}
+
+void ImageReader::open_pgm(bool ascii) {
+    const uint8_t* b = file.data();
+    size_t size = file.size(), pos = 2;
+    // ヘッダの数値を読む (空白と # から行末までのコメントを飛ばす)
+    auto next_int = [&]() {
+        while (pos < size) {
+            if (b[pos] == '#') { while (pos < size && b[pos] != '\n') ++pos; }
+            else if (std::isspace(b[pos])) ++pos;
+            else break;
+        }
+        if (pos >= size || !std::isdigit(b[pos])) throw std::runtime_error(path + ": malformed PGM header");
+        long v = 0;
+        while (pos < size && std::isdigit(b[pos])) v = v * 10 + (b[pos++] - '0');
+        return v;
+    };
+    long width = next_int(), height = next_int(), maxval = next_int();
+    if (width <= 0 || height <= 0) throw std::runtime_error(path + ": invalid PGM size");
+    if (maxval <= 0 || maxval > 255) throw std::runtime_error(path + ": only 8 bit PGM is supported");
+    w = static_cast<int>(width); h = static_cast<int>(height);
+    identity = (maxval == 255);
+    for (long v = 0; v < 256; ++v) {
+        gray_of[v] = static_cast<uint8_t>(maxval == 255 ? v : std::lround(255.0 * std::min(v, maxval) / maxval));
+    }
+    if (ascii) {
+        ascii_pixels.resize(static_cast<size_t>(w) * h);
+        for (uint8_t& px : ascii_pixels) px = gray_of[std::min(next_int(), maxval)];
+        pixels = utils::contiguous_view(static_cast<const uint8_t*>(ascii_pixels.data()), w, h);
+        identity = true;
+        return;
+    }
+    ++pos; // ヘッダ末尾の空白 1 文字
+    if (pos + static_cast<uint64_t>(w) * h > size) throw std::runtime_error(path + ": truncated PGM pixel data");
+    pixels = utils::contiguous_view(b + pos, w, h);
+}
+
+bool ImageReader::view(utils::ImageView& out) const {
+    if (bytes_per_pixel != 1 || !identity) return false;
+    out = pixels;
+    return true;
+}
+
+void ImageReader::read_rows(int y0, int count, uint8_t* out) const {
+    if (y0 < 0 || count < 0 || y0 + count > h) throw std::runtime_error(path + ": row range out of bounds");
+    for (int y = y0; y < y0 + count; ++y, out += w) {
+        const uint8_t* row = pixels.row(y);
+        if (bytes_per_pixel == 1 && identity) std::copy_n(row, w, out);
+        else if (bytes_per_pixel == 1) for (int x = 0; x < w; ++x) out[x] = gray_of[row[x]];
+        else for (int x = 0; x < w; ++x, row += bytes_per_pixel) out[x] = luma(row[2], row[1], row[0]);
+    }
+}
+
+ImageWriter::ImageWriter(const std::string& path_in, int width, int height) : path(path_in), w(width), h(height) {
+    if (w <= 0 || h <= 0) throw std::runtime_error(path + ": invalid image size");
+    if (has_extension(path, ".bmp")) {
+        // 8 bit グレースケール BMP (下端の行から、行は 4 バイト境界に揃える。パディングは 0 のまま)
+        uint64_t stride = (static_cast<uint64_t>(w) + 3) & ~uint64_t(3);
+        uint32_t data_offset = 14 + 40 + 256 * 4;
+        uint32_t data_size = static_cast<uint32_t>(stride * h);
+        file = MappedFile::create(path, data_offset + stride * h);
+        uint8_t* p = file.mutable_data();
+        *p++ = 'B'; *p++ = 'M';
+        put_u32(p, data_offset + data_size); put_u32(p, 0); put_u32(p, data_offset);
+        put_u32(p, 40); put_u32(p, w); put_u32(p, h);
+        put_u16(p, 1); put_u16(p, 8); put_u32(p, 0); put_u32(p, data_size);
+        put_u32(p, 2835); put_u32(p, 2835); put_u32(p, 256); put_u32(p, 0);
+        for (int k = 0; k < 256; ++k) { *p++ = k; *p++ = k; *p++ = k; *p++ = 0; }
+        uint8_t* last_row = file.mutable_data() + data_offset + stride * (h - 1);
+        pixels = {last_row, w, h, -static_cast<std::ptrdiff_t>(stride)};
+    } else {
+        std::string header = has_extension(path, ".raw") ? "" : "P5\n" + std::to_string(w) + " " + std::to_string(h) + "\n255\n";
+        file = MappedFile::create(path, header.size() + static_cast<uint64_t>(w) * h);
+        std::copy(header.begin(), header.end(), file.mutable_data());
+        pixels = utils::contiguous_view(file.mutable_data() + header.size(), w, h);
+    }
+}
+
+void ImageWriter::write_rows(int y0, int count, const uint8_t* rows) {
+    if (y0 < 0 || count < 0 || y0 + count > h) throw std::runtime_error(path + ": row range out of bounds");
+    for (int y = y0; y < y0 + count; ++y, rows += w) std::copy_n(rows, w, pixels.row(y));
+}
+
+void ImageWriter::close() {
+    file.close();
+}
+
+GrayImage read_image(const std::string& path, RawSize raw) {
+    ImageReader reader(path, raw);
+    GrayImage img;
+    img.width = reader.width(); img.height = reader.height();
+    img.pixels.resize(static_cast<size_t>(img.width) * img.height);
+    reader.read_rows(0, img.height, img.pixels.data());
+    return img;
+}
+
+void write_image(const std::string& path, const GrayImage& img) {
+    ImageWriter writer(path, img.width, img.height);
+    writer.write_rows(0, img.height, img.pixels.data());
+    writer.close();
+}
+
+} // namespace io
@@ -0,0 +1,73 @@
+#ifndef IMAGE_IO_HPP
+#define IMAGE_IO_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "mapped_file.hpp"
+#include "../utils/image_view.hpp"
+
+namespace io {
+
+// 8 bit グレースケール画像 (行優先、上端の行から)
+struct GrayImage {
+    int width = 0, height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+// ヘッダのない 8 bit グレースケール (.raw) の画像サイズ
+struct RawSize {
+    int width = 0, height = 0;
+};
+
+// メモリマップした画像の読み込み。BMP (非圧縮の 8 bit パレット / 24 bit / 32 bit)、PGM (P5 / P2, maxval <= 255)、
+// 拡張子 .raw のヘッダなし 8 bit (サイズは raw で与える) に対応し、BMP/PGM は先頭のマジックで判定する。
+// カラーは輝度 (ITU-R BT.601) に変換する。読めなければ std::runtime_error。
+// 8 bit グレースケールのパレット、maxval 255 の P5、raw はマップした画素を変換せずにビューとして渡せる
+class ImageReader {
+public:
+    explicit ImageReader(const std::string& path, RawSize raw = {});
+    int width() const { return w; }
+    int height() const { return h; }
+    // ゼロコピーで読めるならファイル上の画素を指すビューを返す (リーダーが生きている間だけ有効)
+    bool view(utils::ImageView& out) const;
+    // 上端から y0 行目から count 行を out (count * width バイト) に 8 bit グレーで読む
+    void read_rows(int y0, int count, uint8_t* out) const;
+
+private:
+    void open_bmp();
+    void open_pgm(bool ascii);
+
+    std::string path;
+    MappedFile file;
+    int w = 0, h = 0;
+    int bytes_per_pixel = 1;
+    bool identity = true; // 格納値がそのまま 8 bit グレー
+    utils::ImageView pixels; // 画素領域 (1 画素 bytes_per_pixel バイト、BMP の下端から並ぶ行は負のストライド)
+    uint8_t gray_of[256]; // 格納値 (パレット番号または PGM の値) から 8 bit グレーへの変換表
+    std::vector<uint8_t> ascii_pixels; // P2 (テキスト) は開いたときに全画素を変換しておく
+};
+
+// メモリマップした画像の書き出し。開いたときにファイル全体の領域を確保し、行は任意の順に書ける。
+// 拡張子が .bmp なら 8 bit グレースケール BMP、.raw ならヘッダなし、それ以外は PGM (P5)
+class ImageWriter {
+public:
+    ImageWriter(const std::string& path, int width, int height);
+    // ファイル上の画素を指す書き込み用のビュー (エンジンの出力を直接書き込める)
+    utils::MutableImageView view() { return pixels; }
+    void write_rows(int y0, int count, const uint8_t* rows);
+    void close();
+
+private:
+    std::string path;
+    MappedFile file;
+    int w, h;
+    utils::MutableImageView pixels;
+};
+
+GrayImage read_image(const std::string& path, RawSize raw = {});
+void write_image(const std::string& path, const GrayImage& img);
+
+} // namespace io
+
+#endif
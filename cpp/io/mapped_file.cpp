@@ -0,0 +1,79 @@
+#include "mapped_file.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace io {
+
+namespace {
+
+std::runtime_error sys_error(const std::string& path, const char* what) {
+    return std::runtime_error(path + ": " + what + " (" + std::strerror(errno) + ")");
+}
+
+} // namespace
+
+MappedFile MappedFile::open_read(const std::string& path) {
+    MappedFile f;
+    f.path = path;
+    f.fd = ::open(path.c_str(), O_RDONLY);
+    if (f.fd < 0) throw sys_error(path, "cannot open");
+    struct stat st;
+    if (::fstat(f.fd, &st) != 0) throw sys_error(path, "cannot stat");
+    f.len = static_cast<std::size_t>(st.st_size);
+    if (f.len > 0) {
+        void* p = ::mmap(nullptr, f.len, PROT_READ, MAP_SHARED, f.fd, 0);
+        if (p == MAP_FAILED) throw sys_error(path, "mmap failed");
+        f.ptr = static_cast<uint8_t*>(p);
+        ::madvise(p, f.len, MADV_SEQUENTIAL); // 行の帯を先頭から順に読む
+    }
+    return f;
+}
+
+MappedFile MappedFile::create(const std::string& path, std::size_t size) {
+    MappedFile f;
+    f.path = path;
+    f.fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (f.fd < 0) throw sys_error(path, "cannot open for writing");
+    if (::ftruncate(f.fd, static_cast<off_t>(size)) != 0) throw sys_error(path, "cannot resize");
+    f.len = size;
+    if (size > 0) {
+        void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, f.fd, 0);
+        if (p == MAP_FAILED) throw sys_error(path, "mmap failed");
+        f.ptr = static_cast<uint8_t*>(p);
+    }
+    return f;
+}
+
+MappedFile::MappedFile(MappedFile&& o) noexcept
+    : ptr(o.ptr), len(o.len), fd(o.fd), path(std::move(o.path)) {
+    o.ptr = nullptr; o.len = 0; o.fd = -1;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& o) noexcept {
+    if (this != &o) {
+        release();
+        ptr = o.ptr; len = o.len; fd = o.fd; path = std::move(o.path);
+        o.ptr = nullptr; o.len = 0; o.fd = -1;
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile() { release(); }
+
+void MappedFile::release() noexcept {
+    if (ptr) ::munmap(ptr, len);
+    if (fd >= 0) ::close(fd);
+    ptr = nullptr; len = 0; fd = -1;
+}
+
+void MappedFile::close() {
+    // 書き戻しは OS に任せる (バッチでは画像ごとに同期書き込みを待たない)
+    release();
+}
+
+} // namespace io
@@ -0,0 +1,41 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace io {
+
+// ファイル全体のメモリマップ (POSIX mmap)。読み込み専用で開くか、指定サイズで作成して読み書きする。
+// 大きな画像でも実際に触れたページだけが読み込まれ、書き込んだページは OS が順次ファイルへ戻す
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    static MappedFile open_read(const std::string& path);
+    static MappedFile create(const std::string& path, std::size_t size); // 既存のファイルは切り詰める
+
+    MappedFile(MappedFile&& o) noexcept;
+    MappedFile& operator=(MappedFile&& o) noexcept;
+
+    const uint8_t* data() const { return ptr; }
+    uint8_t* mutable_data() { return ptr; }
+    std::size_t size() const { return len; }
+    void close();
+
+private:
+    void release() noexcept;
+
+    uint8_t* ptr = nullptr;
+    std::size_t len = 0;
+    int fd = -1;
+    std::string path;
+};
+
+} // namespace io
+
+#endif
@@ -2,48 +2,135 @@
 #include <emscripten/val.h>
 #include "engine/denoise_engine.hpp"
 #include "utils/numeric_guard.hpp"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#ifdef __EMSCRIPTEN_PTHREADS__
+#include <emscripten/threading.h>
+#endif
 
 using namespace emscripten;
 
 class WasmEngine {
 public:
-    WasmEngine(int w, int h) : engine(w, h), width(w), height(h) {}
+    WasmEngine(int w, int h) : engine(w, h), width(w), height(h),
+        original_input(w * h), noisy_input(w * h), output_buffer(w * h), heatmap_buffer(w * h * 4), initial_heatmap_buffer(w * h * 4),
+        mailbox(std::make_shared<Mailbox>()) {}
+    ~WasmEngine() {
+        engine.cancel(); // 非同期評価の報告を送り終えてから破棄する
+        mailbox->callback = val::undefined(); // 破棄後に届いた報告は捨てる (heatmap_out も無効になる)
+    }
     void setInput(val original_arr, val noisy_arr) {
         auto orig_vec = vecFromJSArray<uint8_t>(original_arr);
         auto noisy_vec = vecFromJSArray<uint8_t>(noisy_arr);
-        engine.set_input(orig_vec.data(), noisy_vec.data(), orig_vec.size());
+        // 短い方の長さを渡し、どちらかが w*h に足りなければエンジン側で例外にする
+        engine.set_input(orig_vec.data(), noisy_vec.data(), static_cast<int>(std::min(orig_vec.size(), noisy_vec.size())));
     }
+    // ゼロコピー入力: JS はヒープ上の入力バッファのビューに画素を直接書き込み、commitInput で取り込む。
+    // メモリ拡張でビューは無効になるので、書き込む直前に取得して保持しないこと
+    val getOriginalInputView() { return val(typed_memory_view(original_input.size(), original_input.data())); }
+    val getNoisyInputView() { return val(typed_memory_view(noisy_input.size(), noisy_input.data())); }
+    void commitInput() { engine.set_input(original_input.data(), noisy_input.data(), static_cast<int>(original_input.size())); }
+    void setNumThreads(int threads) { engine.set_num_threads(threads); }
+    void setSSIMGaussian(bool gaussian) { engine.set_ssim_gaussian(gaussian); }
+    void setProgressPolicy(ProgressPolicy policy) { engine.set_progress_policy(policy); }
     val getOutput() {
-        if (output_buffer.size() != width * height) output_buffer.resize(width * height);
         engine.get_output(output_buffer.data());
         return val(typed_memory_view(output_buffer.size(), output_buffer.data()));
     }
     val getInitialSSIMHeatmap() {
-        if (initial_heatmap_buffer.size() != width * height * 4) initial_heatmap_buffer.resize(width * height * 4);
         engine.get_initial_ssim_heatmap(initial_heatmap_buffer.data());
         return val(typed_memory_view(initial_heatmap_buffer.size(), initial_heatmap_buffer.data()));
     }
     val getSSIMHeatmap() {
-        if (heatmap_buffer.size() != width * height * 4) heatmap_buffer.resize(width * height * 4);
         engine.get_ssim_heatmap(heatmap_buffer.data());
         return val(typed_memory_view(heatmap_buffer.size(), heatmap_buffer.data()));
     }
-    void runGMRF(GMRFParams p, val onStep) {
-        engine.gmrf(p, [&](const IterationResult& res) { onStep(res.iteration, res.energy, res.psnr, res.ssim, res.current_task); });
+    void runGMRF(GMRFParams p, val onStep) { set_callback(onStep); engine.gmrf(p, [this](const IterationResult& res) { forward(res); }); }
+    void runLCMRF(LCMRFParams p, val onStep) { set_callback(onStep); engine.lc_mrf(p, [this](const IterationResult& res) { forward(res); }); }
+    void runHGMRF(HGMRFParams p, val onStep) { set_callback(onStep); engine.hgmrf(p, [this](const IterationResult& res) { forward(res); }); }
+    void runRTVMRF(RTVMRFParams p, val onStep) { set_callback(onStep); engine.rtv_mrf(p, [this](const IterationResult& res) { forward(res); }); }
+    // 再開可能な実行: start* で開始し、JS は step(budgetMs) をタイムスライスごとに呼んで合間にメッセージを処理する。
+    // 中断は cancel を呼ぶだけでよい (コールバックから例外を投げる必要はない)
+    void startGMRF(GMRFParams p, val onStep) { set_callback(onStep); engine.start_gmrf(p, [this](const IterationResult& res) { forward(res); }); }
+    void startLCMRF(LCMRFParams p, val onStep) { set_callback(onStep); engine.start_lc_mrf(p, [this](const IterationResult& res) { forward(res); }); }
+    void startHGMRF(HGMRFParams p, val onStep) { set_callback(onStep); engine.start_hgmrf(p, [this](const IterationResult& res) { forward(res); }); }
+    void startRTVMRF(RTVMRFParams p, val onStep) { set_callback(onStep); engine.start_rtv_mrf(p, [this](const IterationResult& res) { forward(res); }); }
+    int step(double budget_ms) { return engine.step(budget_ms); }
+    void cancel() {
+        engine.cancel();
+        set_callback(val::undefined());
     }
-    void runLCMRF(LCMRFParams p, val onStep) {
-        engine.lc_mrf(p, [&](const IterationResult& res) { onStep(res.iteration, res.energy, res.psnr, res.ssim, res.current_task); });
+private:
+    // JS のコールバック。val は JS スレッド (モジュールを読み込んだ Worker) でしか触れないので、
+    // 非同期評価の報告はここへ持ち帰ってから呼ぶ。共有所有にして、本体の破棄後に届いた報告は捨てる
+    struct Mailbox {
+        val callback = val::undefined();
+        std::atomic<unsigned> issued{0}; // 報告の通し番号 (エンジン側で発行順に振る)
+        unsigned delivered = 0;          // JS へ渡した最新の番号 (JS スレッドだけが触る)
+    };
+    // 指標スレッドから JS スレッドへ渡す 1 報告分の複製
+    struct PendingStep {
+        std::shared_ptr<Mailbox> mailbox;
+        unsigned seq;
+        int iteration;
+        double energy, psnr, ssim;
+        std::string task;
+        std::vector<uint8_t> heatmap;
+        uint8_t* heatmap_out;
+    };
+
+    void set_callback(val cb) {
+        // 前の実行の報告が遅れて届いても新しいコールバックには渡さない
+        mailbox->delivered = mailbox->issued.load();
+        mailbox->callback = cb;
+    }
+
+    // heatmap はコールバック中だけ有効なビュー (null: 計算していない)。非同期評価 (async_metrics) の報告は
+    // 指標スレッドで発生するので、複製して JS スレッドのイベントループへ送る (step の合間に届く)。
+    // 後から発行された報告が先に届いていれば古い報告は捨てる (報告は間引かれてもよい)
+    void forward(const IterationResult& res) {
+        unsigned seq = ++mailbox->issued;
+#ifdef __EMSCRIPTEN_PTHREADS__
+        if (!emscripten_is_main_runtime_thread()) {
+            auto* pending = new PendingStep{mailbox, seq, res.iteration, res.energy, res.psnr, res.ssim, res.current_task, {}, heatmap_buffer.data()};
+            if (res.heatmap) pending->heatmap.assign(res.heatmap, res.heatmap + heatmap_buffer.size());
+            emscripten_async_run_in_main_runtime_thread(EM_FUNC_SIG_VI, reinterpret_cast<void*>(&WasmEngine::deliver_pending), pending);
+            return;
+        }
+#endif
+        if (res.heatmap) std::copy(res.heatmap, res.heatmap + heatmap_buffer.size(), heatmap_buffer.begin());
+        deliver(*mailbox, seq, res.iteration, res.energy, res.psnr, res.ssim, res.current_task, res.heatmap ? heatmap_buffer.data() : nullptr);
     }
-    void runHGMRF(HGMRFParams p, val onStep) {
-        engine.hgmrf(p, [&](const IterationResult& res) { onStep(res.iteration, res.energy, res.psnr, res.ssim, res.current_task); });
+
+    void deliver(Mailbox& box, unsigned seq, int iteration, double energy, double psnr, double ssim, const std::string& task, const uint8_t* heatmap) {
+        if (seq <= box.delivered || box.callback.isUndefined()) return;
+        box.delivered = seq;
+        val hm = heatmap ? val(typed_memory_view(heatmap_buffer.size(), heatmap)) : val::null();
+        box.callback(iteration, energy, psnr, ssim, task, hm);
     }
-    void runRTVMRF(RTVMRFParams p, val onStep) {
-        engine.rtv_mrf(p, [&](const IterationResult& res) { onStep(res.iteration, res.energy, res.psnr, res.ssim, res.current_task); });
+
+#ifdef __EMSCRIPTEN_PTHREADS__
+    static void deliver_pending(void* arg) {
+        std::unique_ptr<PendingStep> pending(static_cast<PendingStep*>(arg));
+        Mailbox& box = *pending->mailbox;
+        if (pending->seq <= box.delivered || box.callback.isUndefined()) return;
+        const uint8_t* heatmap = nullptr;
+        if (!pending->heatmap.empty()) {
+            std::copy(pending->heatmap.begin(), pending->heatmap.end(), pending->heatmap_out);
+            heatmap = pending->heatmap_out;
+        }
+        box.delivered = pending->seq;
+        val hm = heatmap ? val(typed_memory_view(pending->heatmap.size(), heatmap)) : val::null();
+        box.callback(pending->iteration, pending->energy, pending->psnr, pending->ssim, pending->task, hm);
     }
-private:
+#endif
+
     DenoiseEngine engine;
     int width, height;
+    std::vector<uint8_t> original_input, noisy_input;
     std::vector<uint8_t> output_buffer, heatmap_buffer, initial_heatmap_buffer;
+    std::shared_ptr<Mailbox> mailbox;
 };
 
 EMSCRIPTEN_BINDINGS(my_module) {
@@ -51,38 +138,60 @@ EMSCRIPTEN_BINDINGS(my_module) {
         .field("lambda", &GMRFParams::lambda).field("alpha", &GMRFParams::alpha)
         .field("sigma_sq", &GMRFParams::sigma_sq).field("max_iter", &GMRFParams::max_iter)
         .field("is_learning", &GMRFParams::is_learning).field("eta_lambda", &GMRFParams::eta_lambda)
-        .field("eta_alpha", &GMRFParams::eta_alpha);
+        .field("eta_alpha", &GMRFParams::eta_alpha).field("solver", &GMRFParams::solver)
+        .field("precision", &GMRFParams::precision);
 
     value_object<HGMRFParams>("HGMRFParams")
         .field("lambda", &HGMRFParams::lambda).field("alpha", &HGMRFParams::alpha)
         .field("sigma_sq", &HGMRFParams::sigma_sq).field("gamma_sq", &HGMRFParams::gamma_sq)
         .field("max_iter", &HGMRFParams::max_iter).field("is_learning", &HGMRFParams::is_learning)
         .field("eta_lambda", &HGMRFParams::eta_lambda).field("eta_alpha", &HGMRFParams::eta_alpha)
-        .field("eta_gamma2", &HGMRFParams::eta_gamma2).field("verify_likelihood", &HGMRFParams::verify_likelihood);
+        .field("eta_gamma2", &HGMRFParams::eta_gamma2).field("verify_likelihood", &HGMRFParams::verify_likelihood)
+        .field("solver", &HGMRFParams::solver);
 
     value_object<LCMRFParams>("LCMRFParams")
         .field("lambda", &LCMRFParams::lambda).field("alpha", &LCMRFParams::alpha)
         .field("sigma_sq", &LCMRFParams::sigma_sq).field("s", &LCMRFParams::s)
         .field("max_iter", &LCMRFParams::max_iter).field("is_learning", &LCMRFParams::is_learning)
-        .field("epsilon_map", &LCMRFParams::epsilon_map).field("epsilon_pri", &LCMRFParams::epsilon_pri)
+        .field("epsilon_map", &LCMRFParams::epsilon_map).field("map_optimizer", &LCMRFParams::map_optimizer).field("epsilon_pri", &LCMRFParams::epsilon_pri)
         .field("epsilon_post", &LCMRFParams::epsilon_post).field("eta_lambda", &LCMRFParams::eta_lambda)
         .field("eta_alpha", &LCMRFParams::eta_alpha).field("eta_sigma2", &LCMRFParams::eta_sigma2)
         .field("n_pri", &LCMRFParams::n_pri).field("n_post", &LCMRFParams::n_post)
-        .field("t_hat_max", &LCMRFParams::t_hat_max).field("t_dot_max", &LCMRFParams::t_dot_max);
+        .field("t_hat_max", &LCMRFParams::t_hat_max).field("t_dot_max", &LCMRFParams::t_dot_max)
+        .field("persistent_chains", &LCMRFParams::persistent_chains).field("seed", &LCMRFParams::seed)
+        .field("precision", &LCMRFParams::precision);
 
     value_object<RTVMRFParams>("RTVMRFParams")
         .field("lambda", &RTVMRFParams::lambda).field("alpha", &RTVMRFParams::alpha)
         .field("sigma_sq", &RTVMRFParams::sigma_sq).field("max_iter", &RTVMRFParams::max_iter)
-        .field("is_learning", &RTVMRFParams::is_learning);
+        .field("is_learning", &RTVMRFParams::is_learning).field("solver", &RTVMRFParams::solver)
+        .field("tv_solver", &RTVMRFParams::tv_solver);
+
+    value_object<ProgressPolicy>("ProgressPolicy")
+        .field("every_k", &ProgressPolicy::every_k).field("every_ms", &ProgressPolicy::every_ms)
+        .field("compute_metrics", &ProgressPolicy::compute_metrics).field("compute_heatmap", &ProgressPolicy::compute_heatmap)
+        .field("async_metrics", &ProgressPolicy::async_metrics);
 
     class_<WasmEngine>("WasmEngine")
         .constructor<int, int>()
         .function("setInput", &WasmEngine::setInput)
+        .function("getOriginalInputView", &WasmEngine::getOriginalInputView)
+        .function("getNoisyInputView", &WasmEngine::getNoisyInputView)
+        .function("commitInput", &WasmEngine::commitInput)
+        .function("setNumThreads", &WasmEngine::setNumThreads)
+        .function("setSSIMGaussian", &WasmEngine::setSSIMGaussian)
+        .function("setProgressPolicy", &WasmEngine::setProgressPolicy)
         .function("getOutput", &WasmEngine::getOutput)
         .function("runGMRF", &WasmEngine::runGMRF)
         .function("runLCMRF", &WasmEngine::runLCMRF)
         .function("runHGMRF", &WasmEngine::runHGMRF)
         .function("runRTVMRF", &WasmEngine::runRTVMRF)
+        .function("startGMRF", &WasmEngine::startGMRF)
+        .function("startLCMRF", &WasmEngine::startLCMRF)
+        .function("startHGMRF", &WasmEngine::startHGMRF)
+        .function("startRTVMRF", &WasmEngine::startRTVMRF)
+        .function("step", &WasmEngine::step)
+        .function("cancel", &WasmEngine::cancel)
         .function("getSSIMHeatmap", &WasmEngine::getSSIMHeatmap)
         .function("getInitialSSIMHeatmap", &WasmEngine::getInitialSSIMHeatmap);
 }
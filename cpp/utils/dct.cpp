@@ -0,0 +1,128 @@
+#include "dct.hpp"
+#include <cmath>
+#include <algorithm>
+
+namespace utils {
+
+using cplx = std::complex<double>;
+
+FFT::FFT(int length) : n(length), m(1) {
+    bool pow2 = (n & (n - 1)) == 0;
+    int target = pow2 ? n : 2 * n - 1;
+    while (m < target) m <<= 1;
+
+    twiddle.resize(m / 2);
+    for (int k = 0; k < m / 2; ++k) twiddle[k] = std::polar(1.0, -2.0 * M_PI * k / m);
+    bitrev.resize(m);
+    for (int i = 0, j = 0; i < m; ++i) {
+        bitrev[i] = j;
+        int bit = m >> 1;
+        while (bit && (j & bit)) { j ^= bit; bit >>= 1; }
+        j |= bit;
+    }
+
+    if (!pow2) {
+        // Bluestein: X_k = c_k Σ (x_j c_j) conj(c_{k-j}),  c_k = exp(-iπk²/N)
+        chirp.resize(n);
+        for (int k = 0; k < n; ++k) {
+            long long k2 = (static_cast<long long>(k) * k) % (2LL * n);
+            chirp[k] = std::polar(1.0, -M_PI * static_cast<double>(k2) / n);
+        }
+        chirp_fft.assign(m, cplx(0.0, 0.0));
+        chirp_fft[0] = std::conj(chirp[0]);
+        for (int k = 1; k < n; ++k) chirp_fft[k] = chirp_fft[m - k] = std::conj(chirp[k]);
+        radix2(chirp_fft, false);
+        work.resize(m);
+    }
+}
+
+void FFT::radix2(std::vector<cplx>& a, bool inverse) const {
+    for (int i = 0; i < m; ++i) {
+        if (i < bitrev[i]) std::swap(a[i], a[bitrev[i]]);
+    }
+    for (int len = 2; len <= m; len <<= 1) {
+        int half = len >> 1, step = m / len;
+        for (int i = 0; i < m; i += len) {
+            for (int k = 0; k < half; ++k) {
+                cplx t = inverse ? std::conj(twiddle[k * step]) : twiddle[k * step];
+                cplx u = a[i + k], v = a[i + k + half] * t;
+                a[i + k] = u + v;
+                a[i + k + half] = u - v;
+            }
+        }
+    }
+}
+
+void FFT::transform(std::vector<cplx>& a, bool inverse) {
+    double inv_n = 1.0 / static_cast<double>(n);
+    if (m == n) {
+        radix2(a, inverse);
+        if (inverse) for (int i = 0; i < n; ++i) a[i] *= inv_n;
+        return;
+    }
+    // 逆変換は共役を取って順変換に帰着させる
+    for (int k = 0; k < n; ++k) work[k] = (inverse ? std::conj(a[k]) : a[k]) * chirp[k];
+    std::fill(work.begin() + n, work.end(), cplx(0.0, 0.0));
+    radix2(work, false);
+    for (int k = 0; k < m; ++k) work[k] *= chirp_fft[k];
+    radix2(work, true);
+    double inv_m = 1.0 / static_cast<double>(m);
+    for (int k = 0; k < n; ++k) {
+        cplx val = work[k] * inv_m * chirp[k];
+        a[k] = inverse ? std::conj(val) * inv_n : val;
+    }
+}
+
+DCT1D::DCT1D(int length) : n(length), fft(length), shift(length), scale(length), buf(length) {
+    for (int k = 0; k < n; ++k) {
+        shift[k] = std::polar(1.0, -M_PI * k / (2.0 * n));
+        scale[k] = std::sqrt((k == 0 ? 1.0 : 2.0) / n);
+    }
+}
+
+void DCT1D::forward(double* data, int stride) {
+    // 偶数番目を前方、奇数番目を後方から並べた系列の FFT から DCT-II を得る
+    int half = (n + 1) / 2;
+    for (int i = 0; i < half; ++i) buf[i] = cplx(data[2 * i * stride], 0.0);
+    for (int i = 0; 2 * i + 1 < n; ++i) buf[n - 1 - i] = cplx(data[(2 * i + 1) * stride], 0.0);
+    fft.transform(buf, false);
+    for (int k = 0; k < n; ++k) data[k * stride] = scale[k] * (buf[k] * shift[k]).real();
+}
+
+void DCT1D::inverse(double* data, int stride) {
+    // V_k = exp(iπk/2N) (X_k - i X_{N-k}),  X_N = 0
+    for (int k = 0; k < n; ++k) {
+        double xk = data[k * stride] / scale[k];
+        double xnk = (k == 0) ? 0.0 : data[(n - k) * stride] / scale[n - k];
+        buf[k] = std::conj(shift[k]) * cplx(xk, -xnk);
+    }
+    fft.transform(buf, true);
+    int half = (n + 1) / 2;
+    for (int i = 0; i < half; ++i) data[2 * i * stride] = buf[i].real();
+    for (int i = 0; 2 * i + 1 < n; ++i) data[(2 * i + 1) * stride] = buf[n - 1 - i].real();
+}
+
+DCT2D::DCT2D(int width, int height) : w(width), h(height), row(width), col(height) {}
+
+void DCT2D::apply(std::vector<double>& data, bool inverse) {
+    for (int y = 0; y < h; ++y) {
+        if (inverse) row.inverse(&data[y * w], 1);
+        else row.forward(&data[y * w], 1);
+    }
+    for (int x = 0; x < w; ++x) {
+        if (inverse) col.inverse(&data[x], w);
+        else col.forward(&data[x], w);
+    }
+}
+
+void DCT2D::forward(const std::vector<double>& in, std::vector<double>& out) {
+    if (&out != &in) out = in;
+    apply(out, false);
+}
+
+void DCT2D::inverse(const std::vector<double>& in, std::vector<double>& out) {
+    if (&out != &in) out = in;
+    apply(out, true);
+}
+
+} // namespace utils
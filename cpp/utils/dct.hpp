@@ -0,0 +1,57 @@
+#ifndef DCT_HPP
+#define DCT_HPP
+
+#include <complex>
+#include <vector>
+
+namespace utils {
+
+// 任意長の複素 FFT (2 の冪は基数 2、それ以外は Bluestein 法で O(N log N))
+class FFT {
+public:
+    explicit FFT(int length);
+    // in-place 変換。inverse 時は 1/N のスケーリングまで行う
+    void transform(std::vector<std::complex<double>>& a, bool inverse);
+
+private:
+    void radix2(std::vector<std::complex<double>>& a, bool inverse) const;
+
+    int n, m; // m: 基数 2 で処理する長さ (Bluestein 時は 2N-1 以上の 2 の冪)
+    std::vector<std::complex<double>> twiddle;
+    std::vector<int> bitrev;
+    std::vector<std::complex<double>> chirp, chirp_fft, work;
+};
+
+// 直交 DCT-II / DCT-III (1次元, Makhoul 法)
+class DCT1D {
+public:
+    explicit DCT1D(int length);
+    void forward(double* data, int stride);
+    void inverse(double* data, int stride);
+
+private:
+    int n;
+    FFT fft;
+    std::vector<std::complex<double>> shift; // exp(-iπk/2N)
+    std::vector<double> scale;               // 直交化係数 s_k
+    std::vector<std::complex<double>> buf;
+};
+
+// 2次元直交 DCT。Neumann 境界の 5 点ラプラシアンはこの基底で対角化され、
+// 固有値は phi = 4sin²(πx/2w) + 4sin²(πy/2h) となる
+class DCT2D {
+public:
+    DCT2D(int width, int height);
+    void forward(const std::vector<double>& in, std::vector<double>& out);
+    void inverse(const std::vector<double>& in, std::vector<double>& out);
+
+private:
+    void apply(std::vector<double>& data, bool inverse);
+
+    int w, h;
+    DCT1D row, col;
+};
+
+} // namespace utils
+
+#endif
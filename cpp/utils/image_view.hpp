@@ -0,0 +1,31 @@
+#ifndef IMAGE_VIEW_HPP
+#define IMAGE_VIEW_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace utils {
+
+// 行ストライド付きの 8 bit 画像ビュー (画素を所有しない)
+// stride は行の先頭どうしのバイト差で、負でもよい (下端の行から並ぶ BMP をそのまま指せる)
+template <class T>
+struct BasicImageView {
+    T* data = nullptr;
+    int width = 0, height = 0;
+    std::ptrdiff_t stride = 0;
+
+    T* row(int y) const { return data + static_cast<std::ptrdiff_t>(y) * stride; }
+    BasicImageView sub(int x0, int y0, int w, int h) const { return {row(y0) + x0, w, h, stride}; }
+};
+
+using ImageView = BasicImageView<const uint8_t>;
+using MutableImageView = BasicImageView<uint8_t>;
+
+template <class T>
+inline BasicImageView<T> contiguous_view(T* data, int width, int height) {
+    return {data, width, height, static_cast<std::ptrdiff_t>(width)};
+}
+
+} // namespace utils
+
+#endif
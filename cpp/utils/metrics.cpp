@@ -1,3 +1,5 @@
+#include "metrics.hpp"
+#include "simd.hpp"
 #include <vector>
 #include <cmath>
 #include <numeric>
@@ -40,61 +42,233 @@ double calculate_ssim(const std::vector<double>& img1, const std::vector<double>
     return ssim;
 }
 
-// 局所SSIMヒートマップの生成 (WasmからCanvasへ直接描画可能なRGBA配列を返す)
-void generate_ssim_heatmap(const std::vector<double>& orig, const std::vector<double>& denoise, int width, int height, std::vector<uint8_t>& out_rgba) {
-    if (out_rgba.size() != width * height * 4) {
-        out_rgba.resize(width * height * 4);
+void QualityAccumulator::set_reference(const std::vector<double>& orig) {
+    ref = &orig;
+    sum_a = 0; sum_aa = 0;
+    for (double a : orig) { sum_a += a; sum_aa += a * a; }
+}
+
+void QualityAccumulator::evaluate(const std::vector<double>& img, double& psnr, double& ssim) const {
+    const std::vector<double>& orig = *ref;
+    double sum_b = 0, sum_bb = 0, sum_ab = 0, sq_err = 0;
+    for (size_t i = 0; i < img.size(); ++i) {
+        double a = orig[i], b = img[i], d = a - b;
+        sum_b += b; sum_bb += b * b; sum_ab += a * b; sq_err += d * d;
     }
-    
-    int window_size = 11;
-    int half_w = window_size / 2;
+    double n = static_cast<double>(img.size());
+    double mse = sq_err / n;
+    psnr = (mse < 1e-10) ? 100.0 : 10.0 * std::log10(255.0 * 255.0 / mse);
+
     double c1 = 6.5025, c2 = 58.5225;
+    double m1 = sum_a / n, m2 = sum_b / n;
+    double s1 = (sum_aa - n * m1 * m1) / (n - 1);
+    double s2 = (sum_bb - n * m2 * m2) / (n - 1);
+    double s12 = (sum_ab - n * m1 * m2) / (n - 1);
+    ssim = ((2 * m1 * m2 + c1) * (2 * s12 + c2)) / ((m1 * m1 + m2 * m2 + c1) * (s1 + s2 + c2));
+}
 
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            double m1 = 0, m2 = 0, s1 = 0, s2 = 0, s12 = 0;
-            int count = 0;
+namespace {
 
-            for (int wy = -half_w; wy <= half_w; ++wy) {
-                for (int wx = -half_w; wx <= half_w; ++wx) {
-                    int nx = std::clamp(x + wx, 0, width - 1);
-                    int ny = std::clamp(y + wy, 0, height - 1);
-                    int idx = ny * width + nx;
-                    
-                    m1 += orig[idx];
-                    m2 += denoise[idx];
-                    count++;
+// 局所窓の 1 次・2 次モーメント (窓内の和、またはガウス重み付き和)
+struct Moments {
+    double a = 0, b = 0, aa = 0, bb = 0, ab = 0;
+    Moments& operator+=(const Moments& o) { a += o.a; b += o.b; aa += o.aa; bb += o.bb; ab += o.ab; return *this; }
+    Moments& operator-=(const Moments& o) { a -= o.a; b -= o.b; aa -= o.aa; bb -= o.bb; ab -= o.ab; return *this; }
+};
+static_assert(sizeof(Moments) == 5 * sizeof(double), "Moments must be five packed doubles");
+
+// Moments の配列を長さ 5n の double 配列として扱い、2 要素ずつ SIMD で処理する。
+// 各要素の演算順序は Moments 単位の演算と同じなので結果は変わらない
+inline double* flat(std::vector<Moments>& v) { return reinterpret_cast<double*>(v.data()); }
+inline const double* flat(const std::vector<Moments>& v) { return reinterpret_cast<const double*>(v.data()); }
+
+// out[j] = (out[j] + add[j]) - sub[j] (sub が nullptr なら加算のみ)
+void accumulate(double* out, const double* add, const double* sub, int n) {
+    using namespace simd;
+    int j = 0;
+    if (sub) {
+        for (; j + 1 < n; j += 2) store(out + j, (load(out + j) + load(add + j)) - load(sub + j));
+        for (; j < n; ++j) out[j] = (out[j] + add[j]) - sub[j];
+    } else {
+        for (; j + 1 < n; j += 2) store(out + j, load(out + j) + load(add + j));
+        for (; j < n; ++j) out[j] = out[j] + add[j];
+    }
+}
+
+// out[j] = out[j] + r[j]·t
+void accumulate_scaled(double* out, const double* r, double t, int n) {
+    using namespace simd;
+    const f64x2 vt = splat(t);
+    int j = 0;
+    for (; j + 1 < n; j += 2) store(out + j, load(out + j) + load(r + j) * vt);
+    for (; j < n; ++j) out[j] = out[j] + r[j] * t;
+}
+
+// 11x11 窓の分離可能フィルタ。画像外は端の画素を複製する (従来の clamp 付き窓と同じ)。
+// 箱型窓は移動和なので窓サイズに依らず O(n)、ガウス窓は 1 次元タップの畳み込み。
+// 縦方向は横方向にフィルタした行をリングバッファに保持し、全画像分の中間配列を持たない
+class SeparableWindow {
+public:
+    SeparableWindow(const std::vector<double>& img1, const std::vector<double>& img2, int width, int height, bool gaussian)
+        : img1(img1), img2(img2), width(width), height(height), gaussian(gaussian),
+          ring(kRing, std::vector<Moments>(width)), column(width), padded(width + 2 * kHalf) {
+        if (gaussian) {
+            double sum = 0;
+            for (int k = -kHalf; k <= kHalf; ++k) { taps[k + kHalf] = std::exp(-0.5 * k * k / (1.5 * 1.5)); sum += taps[k + kHalf]; }
+            for (double& t : taps) t /= sum;
+        }
+    }
+
+    // 行 y の各画素の窓内モーメントを out に書き出す (y は任意の行から 1 ずつ増やして呼ぶ)
+    void next_row(int y, std::vector<Moments>& out) {
+        if (gaussian) {
+            for (int k = -kHalf; k <= kHalf; ++k) ensure_row(clamp_row(y + k));
+            std::fill(out.begin(), out.end(), Moments{});
+            for (int k = -kHalf; k <= kHalf; ++k) {
+                accumulate_scaled(flat(out), flat(ring[clamp_row(y + k) % kRing]), taps[k + kHalf], 5 * width);
+            }
+            return;
+        }
+        if (!column_ready) {
+            column_ready = true;
+            std::fill(column.begin(), column.end(), Moments{});
+            for (int k = -kHalf; k <= kHalf; ++k) accumulate(flat(column), flat(row_sums(clamp_row(y + k))), nullptr, 5 * width);
+        } else {
+            const std::vector<Moments>& add = row_sums(clamp_row(y + kHalf));
+            const std::vector<Moments>& sub = row_sums(clamp_row(y - 1 - kHalf));
+            accumulate(flat(column), flat(add), flat(sub), 5 * width);
+        }
+        out = column;
+    }
+
+    static constexpr int kHalf = 5;
+    static constexpr int kCount = (2 * kHalf + 1) * (2 * kHalf + 1);
+
+private:
+    static constexpr int kRing = 2 * kHalf + 2; // 移動和で足す行と引く行を同時に保持できる大きさ
+
+    int clamp_row(int y) const { return std::clamp(y, 0, height - 1); }
+
+    const std::vector<Moments>& row_sums(int y) {
+        ensure_row(y);
+        return ring[y % kRing];
+    }
+
+    // 行 y の横方向フィルタ結果をリングバッファに用意する
+    void ensure_row(int y) {
+        if (y <= last_row) return;
+        // リングに残るのは直近 kRing 行だけなので、それより前の行は計算しない
+        for (int r = std::max(last_row + 1, y - kRing + 1); r <= y; ++r) {
+            std::vector<Moments>& out = ring[r % kRing];
+            const double* p1 = img1.data() + static_cast<long long>(r) * width;
+            const double* p2 = img2.data() + static_cast<long long>(r) * width;
+            // 端を複製したパディング行を作り、内側のループから clamp をなくす
+            for (int x = -kHalf; x < width + kHalf; ++x) {
+                int sx = std::clamp(x, 0, width - 1);
+                Moments& m = padded[x + kHalf];
+                m.a = p1[sx]; m.b = p2[sx]; m.aa = p1[sx] * p1[sx]; m.bb = p2[sx] * p2[sx]; m.ab = p1[sx] * p2[sx];
+            }
+            using namespace simd;
+            const double* pad = flat(padded);
+            double* dst = flat(out);
+            int n = 5 * width;
+            if (gaussian) {
+                // dst[j] = Σ_k taps[k]·pad[j + 5k]
+                int j = 0;
+                for (; j + 1 < n; j += 2) {
+                    f64x2 m = splat(0.0);
+                    for (int k = 0; k <= 2 * kHalf; ++k) m += load(pad + j + 5 * k) * splat(taps[k]);
+                    store(dst + j, m);
+                }
+                for (; j < n; ++j) {
+                    double m = 0.0;
+                    for (int k = 0; k <= 2 * kHalf; ++k) m += pad[j + 5 * k] * taps[k];
+                    dst[j] = m;
+                }
+            } else {
+                // 先頭画素は窓内の和、以降は入る画素を足して出る画素を引く移動和。
+                // 5 成分を (a, b), (aa, bb) の 2 ベクトルと ab のスカラーに分けてレジスタ上で更新する
+                for (int j = 0; j < 5; ++j) {
+                    double m = 0.0;
+                    for (int k = 0; k <= 2 * kHalf; ++k) m += pad[j + 5 * k];
+                    dst[j] = m;
+                }
+                f64x2 m01 = load(dst), m23 = load(dst + 2);
+                double m4 = dst[4];
+                for (int j = 5; j < n; j += 5) {
+                    const double* in = pad + j + 10 * kHalf;
+                    const double* gone = pad + j - 5;
+                    m01 = (m01 + load(in)) - load(gone);
+                    m23 = (m23 + load(in + 2)) - load(gone + 2);
+                    m4 = (m4 + in[4]) - gone[4];
+                    store(dst + j, m01);
+                    store(dst + j + 2, m23);
+                    dst[j + 4] = m4;
                 }
             }
-            m1 /= count; m2 /= count;
+        }
+        last_row = y;
+    }
+
+    const std::vector<double>& img1;
+    const std::vector<double>& img2;
+    int width, height;
+    bool gaussian;
+    double taps[2 * kHalf + 1] = {};
+    std::vector<std::vector<Moments>> ring;
+    std::vector<Moments> column, padded;
+    int last_row = -1;
+    bool column_ready = false;
+};
+
+} // namespace
+
+// 局所SSIMヒートマップの生成 (WasmからCanvasへ直接描画可能なRGBA配列を返す)
+// gaussian = true で標準 SSIM と同じ σ=1.5 のガウス窓、false で 11x11 の箱型窓 (不偏分散)
+void generate_ssim_heatmap(const std::vector<double>& orig, const std::vector<double>& denoise, int width, int height, uint8_t* out_rgba, bool gaussian, ThreadPool* pool) {
+    double c1 = 6.5025, c2 = 58.5225;
+    double count = SeparableWindow::kCount;
+
+    // 行バンドごとに独立した窓で処理する。バンドの大きさは固定なので結果はスレッド数に依存しない
+    const int band = 64;
+    int bands = (height + band - 1) / band;
+    auto run_bands = [&](int b0, int b1) {
+        for (int bi = b0; bi < b1; ++bi) {
+            SeparableWindow window(orig, denoise, width, height, gaussian);
+            std::vector<Moments> row(width);
+            for (int y = bi * band; y < std::min(height, (bi + 1) * band); ++y) {
+                window.next_row(y, row);
+                for (int x = 0; x < width; ++x) {
+                    const Moments& s = row[x];
+                    double m1, m2, s1, s2, s12;
+                    if (gaussian) {
+                        m1 = s.a; m2 = s.b;
+                        s1 = s.aa - m1 * m1; s2 = s.bb - m2 * m2; s12 = s.ab - m1 * m2;
+                    } else {
+                        m1 = s.a / count; m2 = s.b / count;
+                        s1 = (s.aa - count * m1 * m1) / (count - 1);
+                        s2 = (s.bb - count * m2 * m2) / (count - 1);
+                        s12 = (s.ab - count * m1 * m2) / (count - 1);
+                    }
 
-            for (int wy = -half_w; wy <= half_w; ++wy) {
-                for (int wx = -half_w; wx <= half_w; ++wx) {
-                    int nx = std::clamp(x + wx, 0, width - 1);
-                    int ny = std::clamp(y + wy, 0, height - 1);
-                    int idx = ny * width + nx;
+                    double local_ssim = ((2 * m1 * m2 + c1) * (2 * s12 + c2)) / ((m1 * m1 + m2 * m2 + c1) * (s1 + s2 + c2));
                     
-                    s1 += (orig[idx] - m1) * (orig[idx] - m1);
-                    s2 += (denoise[idx] - m2) * (denoise[idx] - m2);
-                    s12 += (orig[idx] - m1) * (denoise[idx] - m2);
+                    // 色変換: SSIM(1.0)=青(良い), SSIM(0.0以下)=赤(悪い)
+                    double val = std::clamp(local_ssim, 0.0, 1.0);
+                    uint8_t r = static_cast<uint8_t>(std::clamp(255.0 * (1.0 - val), 0.0, 255.0));
+                    uint8_t b = static_cast<uint8_t>(std::clamp(255.0 * val, 0.0, 255.0));
+                    
+                    long long out_idx = (static_cast<long long>(y) * width + x) * 4;
+                    out_rgba[out_idx] = r;       // R
+                    out_rgba[out_idx + 1] = 0;   // G
+                    out_rgba[out_idx + 2] = b;   // B
+                    out_rgba[out_idx + 3] = 255; // Alpha (完全不透明にして明度を統一)
                 }
             }
-            s1 /= (count - 1); s2 /= (count - 1); s12 /= (count - 1);
-
-            double local_ssim = ((2 * m1 * m2 + c1) * (2 * s12 + c2)) / ((m1 * m1 + m2 * m2 + c1) * (s1 + s2 + c2));
-            
-            // 色変換: SSIM(1.0)=青(良い), SSIM(0.0以下)=赤(悪い)
-            double val = std::clamp(local_ssim, 0.0, 1.0);
-            uint8_t r = static_cast<uint8_t>(std::clamp(255.0 * (1.0 - val), 0.0, 255.0));
-            uint8_t b = static_cast<uint8_t>(std::clamp(255.0 * val, 0.0, 255.0));
-            
-            int out_idx = (y * width + x) * 4;
-            out_rgba[out_idx] = r;       // R
-            out_rgba[out_idx + 1] = 0;   // G
-            out_rgba[out_idx + 2] = b;   // B
-            out_rgba[out_idx + 3] = 255; // Alpha (完全不透明にして明度を統一)
         }
-    }
+    };
+    if (pool) pool->parallel_for(0, bands, run_bands);
+    else run_bands(0, bands);
 }
 
 } // namespace utils
@@ -0,0 +1,36 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "thread_pool.hpp"
+
+namespace utils {
+
+double calculate_psnr(const std::vector<double>& orig, const std::vector<double>& denoise);
+double calculate_ssim(const std::vector<double>& img1, const std::vector<double>& img2);
+// out_rgba には width * height * 4 バイトの領域を渡す (WASM ヒープ上の出力バッファへ直接書き込める)。
+// pool を渡すと固定サイズの行バンドに分けて並列に計算する
+void generate_ssim_heatmap(const std::vector<double>& orig, const std::vector<double>& denoise, int width, int height, uint8_t* out_rgba, bool gaussian, ThreadPool* pool = nullptr);
+
+inline void generate_ssim_heatmap(const std::vector<double>& orig, const std::vector<double>& denoise, int width, int height, std::vector<uint8_t>& out_rgba, bool gaussian, ThreadPool* pool = nullptr) {
+    out_rgba.resize(static_cast<std::size_t>(width) * height * 4);
+    generate_ssim_heatmap(orig, denoise, width, height, out_rgba.data(), gaussian, pool);
+}
+
+// PSNR と大域 SSIM を 1 パスで求める累積器。原画像側の和 Σa, Σa² は入力設定時に一度だけ求めておき、
+// 評価時は Σb, Σb², Σab, Σ(a-b)² だけを積算する (calculate_psnr / calculate_ssim と同じ式)
+class QualityAccumulator {
+public:
+    void set_reference(const std::vector<double>& orig);
+    void evaluate(const std::vector<double>& img, double& psnr, double& ssim) const;
+
+private:
+    const std::vector<double>* ref = nullptr;
+    double sum_a = 0, sum_aa = 0;
+};
+
+} // namespace utils
+
+#endif
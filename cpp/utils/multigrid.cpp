@@ -0,0 +1,196 @@
+#include "multigrid.hpp"
+#include <cmath>
+#include <algorithm>
+
+namespace utils {
+
+namespace {
+    constexpr int COARSEST_CELLS = 64;
+
+    double dot(const std::vector<double>& a, const std::vector<double>& b) {
+        double s = 0.0;
+        for (size_t i = 0; i < a.size(); ++i) s += a[i] * b[i];
+        return s;
+    }
+}
+
+Multigrid::Multigrid(int width, int height) {
+    Level fine{width, height};
+    int n = width * height;
+    fine.mass.assign(n, 1.0);
+    fine.east.assign(n, 0.0);
+    fine.south.assign(n, 0.0);
+    fine.deg.assign(n, 0.0);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int i = y * width + x;
+            if (x < width - 1) { fine.east[i] = 1.0; fine.deg[i] += 1.0; fine.deg[i + 1] += 1.0; }
+            if (y < height - 1) { fine.south[i] = 1.0; fine.deg[i] += 1.0; fine.deg[i + width] += 1.0; }
+        }
+    }
+    levels.push_back(fine);
+
+    while (levels.back().w * levels.back().h > COARSEST_CELLS) {
+        const Level& f = levels.back();
+        Level c{f.w > 1 ? (f.w + 1) / 2 : 1, f.h > 1 ? (f.h + 1) / 2 : 1};
+        int nc = c.w * c.h;
+        c.mass.assign(nc, 0.0); c.east.assign(nc, 0.0); c.south.assign(nc, 0.0); c.deg.assign(nc, 0.0);
+        int sx = f.w > 1 ? 2 : 1, sy = f.h > 1 ? 2 : 1;
+        // 区分定数補間の Galerkin 演算子はラプラシアン部分を 2 倍硬く見積もるため、
+        // 2 次元集約では辺の重みを半分にして再離散化と同じスケールに揃える
+        double edge_scale = (sx == 2 && sy == 2) ? 0.5 : 1.0;
+        for (int y = 0; y < f.h; ++y) {
+            for (int x = 0; x < f.w; ++x) {
+                int i = y * f.w + x;
+                int ci = (y / sy) * c.w + (x / sx);
+                c.mass[ci] += f.mass[i];
+                // 集約内部の辺は P^T L P で打ち消されるので、集約を跨ぐ辺だけを残す
+                if (x < f.w - 1 && (x + 1) / sx != x / sx) c.east[ci] += edge_scale * f.east[i];
+                if (y < f.h - 1 && (y + 1) / sy != y / sy) c.south[ci] += edge_scale * f.south[i];
+            }
+        }
+        for (int y = 0; y < c.h; ++y) {
+            for (int x = 0; x < c.w; ++x) {
+                int i = y * c.w + x;
+                if (x < c.w - 1) { c.deg[i] += c.east[i]; c.deg[i + 1] += c.east[i]; }
+                if (y < c.h - 1) { c.deg[i] += c.south[i]; c.deg[i + c.w] += c.south[i]; }
+            }
+        }
+        levels.push_back(c);
+    }
+    for (auto& lv : levels) {
+        int nl = lv.w * lv.h;
+        lv.x.resize(nl); lv.b.resize(nl); lv.r.resize(nl);
+    }
+}
+
+void Multigrid::apply(const Level& lv, double c, double alpha, const std::vector<double>& x, std::vector<double>& out) const {
+    int lw = lv.w, lh = lv.h;
+    for (int y = 0; y < lh; ++y) {
+        for (int xx = 0; xx < lw; ++xx) {
+            int i = y * lw + xx;
+            double sum = 0.0;
+            if (xx > 0) sum += lv.east[i - 1] * x[i - 1];
+            if (xx < lw - 1) sum += lv.east[i] * x[i + 1];
+            if (y > 0) sum += lv.south[i - lw] * x[i - lw];
+            if (y < lh - 1) sum += lv.south[i] * x[i + lw];
+            out[i] = (c * lv.mass[i] + alpha * lv.deg[i]) * x[i] - alpha * sum;
+        }
+    }
+}
+
+void Multigrid::smooth(Level& lv, double c, double alpha, bool reverse) const {
+    int lw = lv.w, nl = lv.w * lv.h;
+    for (int k = 0; k < nl; ++k) {
+        int i = reverse ? nl - 1 - k : k;
+        int xx = i % lw;
+        double sum = 0.0;
+        if (xx > 0) sum += lv.east[i - 1] * lv.x[i - 1];
+        if (xx < lw - 1) sum += lv.east[i] * lv.x[i + 1];
+        if (i >= lw) sum += lv.south[i - lw] * lv.x[i - lw];
+        if (i + lw < nl) sum += lv.south[i] * lv.x[i + lw];
+        lv.x[i] = (lv.b[i] + alpha * sum) / std::max(c * lv.mass[i] + alpha * lv.deg[i], 1e-300);
+    }
+}
+
+void Multigrid::factor_coarsest(double c, double alpha) {
+    if (c == chol_c && alpha == chol_alpha) return;
+    const Level& lv = levels.back();
+    int nl = lv.w * lv.h;
+    chol.assign(nl * nl, 0.0);
+    for (int i = 0; i < nl; ++i) {
+        chol[i * nl + i] = c * lv.mass[i] + alpha * lv.deg[i];
+        int xx = i % lv.w;
+        if (xx < lv.w - 1) chol[i * nl + i + 1] = chol[(i + 1) * nl + i] = -alpha * lv.east[i];
+        if (i + lv.w < nl) chol[i * nl + i + lv.w] = chol[(i + lv.w) * nl + i] = -alpha * lv.south[i];
+    }
+    // 下三角 Cholesky 分解 (c が極小でも正定値性が崩れないよう対角を下限で保護)
+    for (int j = 0; j < nl; ++j) {
+        double d = chol[j * nl + j];
+        for (int k = 0; k < j; ++k) d -= chol[j * nl + k] * chol[j * nl + k];
+        d = std::sqrt(std::max(d, 1e-300));
+        chol[j * nl + j] = d;
+        for (int i = j + 1; i < nl; ++i) {
+            double s = chol[i * nl + j];
+            for (int k = 0; k < j; ++k) s -= chol[i * nl + k] * chol[j * nl + k];
+            chol[i * nl + j] = s / d;
+        }
+    }
+    chol_c = c; chol_alpha = alpha;
+}
+
+void Multigrid::solve_coarsest(Level& lv) const {
+    int nl = lv.w * lv.h;
+    for (int i = 0; i < nl; ++i) {
+        double s = lv.b[i];
+        for (int k = 0; k < i; ++k) s -= chol[i * nl + k] * lv.x[k];
+        lv.x[i] = s / chol[i * nl + i];
+    }
+    for (int i = nl - 1; i >= 0; --i) {
+        double s = lv.x[i];
+        for (int k = i + 1; k < nl; ++k) s -= chol[k * nl + i] * lv.x[k];
+        lv.x[i] = s / chol[i * nl + i];
+    }
+}
+
+void Multigrid::vcycle(size_t l, double c, double alpha) {
+    Level& lv = levels[l];
+    if (l + 1 == levels.size()) {
+        solve_coarsest(lv);
+        return;
+    }
+    std::fill(lv.x.begin(), lv.x.end(), 0.0);
+    smooth(lv, c, alpha, false);
+    apply(lv, c, alpha, lv.x, lv.r);
+    for (size_t i = 0; i < lv.r.size(); ++i) lv.r[i] = lv.b[i] - lv.r[i];
+
+    Level& cl = levels[l + 1];
+    int sx = lv.w > 1 ? 2 : 1, sy = lv.h > 1 ? 2 : 1;
+    std::fill(cl.b.begin(), cl.b.end(), 0.0);
+    for (int y = 0; y < lv.h; ++y) {
+        for (int x = 0; x < lv.w; ++x) cl.b[(y / sy) * cl.w + x / sx] += lv.r[y * lv.w + x];
+    }
+    vcycle(l + 1, c, alpha);
+    for (int y = 0; y < lv.h; ++y) {
+        for (int x = 0; x < lv.w; ++x) lv.x[y * lv.w + x] += cl.x[(y / sy) * cl.w + x / sx];
+    }
+    // 後平滑化は逆順にして前処理を対称に保つ
+    smooth(lv, c, alpha, true);
+}
+
+int Multigrid::solve(double c, double alpha, const std::vector<double>& b, std::vector<double>& x, double tol, int max_cycles) {
+    Level& fine = levels.front();
+    size_t n = b.size();
+    r.resize(n); z.resize(n); p.resize(n); ap.resize(n);
+    factor_coarsest(c, alpha);
+
+    apply(fine, c, alpha, x, r);
+    for (size_t i = 0; i < n; ++i) r[i] = b[i] - r[i];
+    double b_norm = std::sqrt(dot(b, b));
+    double stop = tol * std::max(b_norm, 1e-300);
+    if (std::sqrt(dot(r, r)) <= stop) return 0;
+
+    auto precondition = [&]() {
+        fine.b = r;
+        vcycle(0, c, alpha);
+        z = fine.x;
+    };
+    precondition();
+    p = z;
+    double rz = dot(r, z);
+    int cycles = 1;
+    for (; cycles <= max_cycles; ++cycles) {
+        apply(fine, c, alpha, p, ap);
+        double step = rz / std::max(dot(p, ap), 1e-300);
+        for (size_t i = 0; i < n; ++i) { x[i] += step * p[i]; r[i] -= step * ap[i]; }
+        if (std::sqrt(dot(r, r)) <= stop) break;
+        precondition();
+        double rz_new = dot(r, z);
+        double beta = rz_new / std::max(rz, 1e-300);
+        rz = rz_new;
+        for (size_t i = 0; i < n; ++i) p[i] = z[i] + beta * p[i];
+    }
+    return std::min(cycles, max_cycles);
+}
+
+} // namespace utils
@@ -0,0 +1,42 @@
+#ifndef MULTIGRID_HPP
+#define MULTIGRID_HPP
+
+#include <cstddef>
+#include <vector>
+
+namespace utils {
+
+// (c I + α L) x = b を解く幾何マルチグリッド (L: Neumann 境界の 5 点グラフラプラシアン)
+// 2x2 集約で粗視化し、粗い演算子は Galerkin 射影 P^T A P (辺の重みを補正) で構成する。
+// 奇数サイズでは端の集約が 1 列/1 行になるので、任意の w/h を扱える。
+// 対称 V サイクルを前処理とする共役勾配法で解くため、収束はメッシュサイズに依存しない。
+class Multigrid {
+public:
+    Multigrid(int width, int height);
+
+    // x を初期値として解き、使用した V サイクル数を返す
+    int solve(double c, double alpha, const std::vector<double>& b, std::vector<double>& x, double tol = 1.0e-6, int max_cycles = 50);
+
+private:
+    // 各レベルは (c·mass + α·deg) x_i - α Σ count·x_j の形の可変係数 5 点ステンシル
+    struct Level {
+        int w = 0, h = 0;
+        std::vector<double> mass{}, deg{}, east{}, south{}; // 集約セル数と跨ぐ辺の本数
+        std::vector<double> x{}, b{}, r{};
+    };
+
+    void apply(const Level& lv, double c, double alpha, const std::vector<double>& x, std::vector<double>& out) const;
+    void smooth(Level& lv, double c, double alpha, bool reverse) const;
+    void factor_coarsest(double c, double alpha);
+    void solve_coarsest(Level& lv) const;
+    void vcycle(std::size_t l, double c, double alpha);
+
+    std::vector<Level> levels;
+    std::vector<double> chol;  // 最粗レベルの Cholesky 因子 (密行列)
+    double chol_c = -1.0, chol_alpha = -1.0;
+    std::vector<double> r, z, p, ap;
+};
+
+} // namespace utils
+
+#endif
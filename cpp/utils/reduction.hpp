@@ -0,0 +1,26 @@
+#ifndef REDUCTION_HPP
+#define REDUCTION_HPP
+
+#include <vector>
+#include "thread_pool.hpp"
+
+namespace utils {
+
+// 行単位の融合リダクション
+// row_fn(y, partial) が 1 行分の統計量を partial に積算し、行ごとの部分和を対ごとに
+// 足し合わせる。加算順序は行数だけで決まるので、結果はスレッド数に依存しない
+template <class Stats, class RowFn>
+Stats reduce_rows(ThreadPool& pool, int h, std::vector<Stats>& partial, RowFn row_fn) {
+    partial.assign(h, Stats{});
+    pool.parallel_for(0, h, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) row_fn(y, partial[y]);
+    });
+    for (int stride = 1; stride < h; stride *= 2) {
+        for (int y = 0; y + stride < h; y += 2 * stride) partial[y] += partial[y + stride];
+    }
+    return partial[0];
+}
+
+} // namespace utils
+
+#endif
@@ -0,0 +1,75 @@
+#include "rng.hpp"
+#include <cmath>
+
+namespace utils {
+
+namespace {
+
+inline void philox_round(uint32_t c[4], const uint32_t k[2]) {
+    uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * c[0];
+    uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * c[2];
+    uint32_t hi0 = static_cast<uint32_t>(p0 >> 32), lo0 = static_cast<uint32_t>(p0);
+    uint32_t hi1 = static_cast<uint32_t>(p1 >> 32), lo1 = static_cast<uint32_t>(p1);
+    c[0] = hi1 ^ c[1] ^ k[0];
+    c[1] = lo1;
+    c[2] = hi0 ^ c[3] ^ k[1];
+    c[3] = lo0;
+}
+
+// 上位 53 bit から (0, 1) の一様乱数を作る (0 を含まないので log に渡せる)
+inline double to_unit(uint32_t hi, uint32_t lo) {
+    uint64_t bits = (static_cast<uint64_t>(hi) << 32) | lo;
+    return (static_cast<double>(bits >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+} // namespace
+
+Philox::Philox(uint64_t seed, uint64_t stream) {
+    key[0] = static_cast<uint32_t>(seed);
+    key[1] = static_cast<uint32_t>(seed >> 32);
+    stream_word[0] = static_cast<uint32_t>(stream);
+    stream_word[1] = static_cast<uint32_t>(stream >> 32);
+}
+
+void Philox::block(uint64_t index, uint32_t out[4]) const {
+    uint32_t c[4] = {static_cast<uint32_t>(index), static_cast<uint32_t>(index >> 32), stream_word[0], stream_word[1]};
+    uint32_t k[2] = {key[0], key[1]};
+    for (int r = 0; r < 10; ++r) {
+        philox_round(c, k);
+        k[0] += 0x9E3779B9u;
+        k[1] += 0xBB67AE85u;
+    }
+    for (int j = 0; j < 4; ++j) out[j] = c[j];
+}
+
+void Philox::fill_normal(double* out, int count) {
+    int pairs = count / 2;
+    // 1. 一様乱数の対を生成 (各ブロックは独立)
+    for (int b = 0; b < pairs; ++b) {
+        uint32_t r[4];
+        block(counter + b, r);
+        out[2 * b] = to_unit(r[0], r[1]);
+        out[2 * b + 1] = to_unit(r[2], r[3]);
+    }
+    // 2. Box-Muller 変換 (両方の出力を使う)
+    for (int b = 0; b < pairs; ++b) {
+        double radius = std::sqrt(-2.0 * std::log(out[2 * b]));
+        double theta = 2.0 * M_PI * out[2 * b + 1];
+        out[2 * b] = radius * std::cos(theta);
+        out[2 * b + 1] = radius * std::sin(theta);
+    }
+    counter += pairs;
+    if (count & 1) {
+        uint32_t r[4];
+        block(counter++, r);
+        out[count - 1] = std::sqrt(-2.0 * std::log(to_unit(r[0], r[1]))) * std::cos(2.0 * M_PI * to_unit(r[2], r[3]));
+    }
+}
+
+double Philox::uniform() {
+    uint32_t r[4];
+    block(counter++, r);
+    return to_unit(r[0], r[1]);
+}
+
+} // namespace utils
@@ -0,0 +1,32 @@
+#ifndef RNG_HPP
+#define RNG_HPP
+
+#include <cstdint>
+
+namespace utils {
+
+// カウンタベース乱数 Philox4x32-10
+// 出力は (seed, stream, counter) だけで決まり内部に共有状態を持たないので、
+// 連鎖やスレッドごとに stream を変えたインスタンスを持てば並列に使える
+class Philox {
+public:
+    explicit Philox(uint64_t seed = 0, uint64_t stream = 0);
+
+    // 標準正規乱数を count 個生成する。1 ブロック (128 bit) から一様乱数 2 個を作り、
+    // Box-Muller の cos/sin 両方の出力を使う。乱数生成と変換を別ループにしてベクトル化しやすくしている
+    void fill_normal(double* out, int count);
+
+    // (0, 1) の一様乱数
+    double uniform();
+
+private:
+    void block(uint64_t index, uint32_t out[4]) const;
+
+    uint32_t key[2];
+    uint32_t stream_word[2];
+    uint64_t counter = 0;
+};
+
+} // namespace utils
+
+#endif
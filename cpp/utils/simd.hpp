@@ -0,0 +1,137 @@
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace utils {
+namespace simd {
+
+// double 2 レーンのベクトル。WASM は SIMD128 (-msimd128)、x86 は SSE2、それ以外は 2 要素の構造体で
+// 同じ演算を行う。各レーンはどの実装でも同じ IEEE 演算列になるので、結果は実装に依存しない
+#if defined(__wasm_simd128__)
+struct f64x2 { v128_t v; };
+inline f64x2 load(const double* p) { return {wasm_v128_load(p)}; }
+inline void store(double* p, f64x2 a) { wasm_v128_store(p, a.v); }
+inline f64x2 splat(double x) { return {wasm_f64x2_splat(x)}; }
+inline f64x2 make(double lo, double hi) { return {wasm_f64x2_make(lo, hi)}; }
+inline double lane0(f64x2 a) { return wasm_f64x2_extract_lane(a.v, 0); }
+inline double lane1(f64x2 a) { return wasm_f64x2_extract_lane(a.v, 1); }
+inline f64x2 operator+(f64x2 a, f64x2 b) { return {wasm_f64x2_add(a.v, b.v)}; }
+inline f64x2 operator-(f64x2 a, f64x2 b) { return {wasm_f64x2_sub(a.v, b.v)}; }
+inline f64x2 operator*(f64x2 a, f64x2 b) { return {wasm_f64x2_mul(a.v, b.v)}; }
+inline f64x2 operator/(f64x2 a, f64x2 b) { return {wasm_f64x2_div(a.v, b.v)}; }
+// pmax/pmin は std::max/std::min と同じ (a < b ? b : a) の意味を持つ
+inline f64x2 max(f64x2 a, f64x2 b) { return {wasm_f64x2_pmax(a.v, b.v)}; }
+inline f64x2 min(f64x2 a, f64x2 b) { return {wasm_f64x2_pmin(a.v, b.v)}; }
+inline f64x2 abs(f64x2 a) { return {wasm_f64x2_abs(a.v)}; }
+inline f64x2 copysign(f64x2 mag, f64x2 sgn) {
+    return {wasm_v128_bitselect(sgn.v, mag.v, wasm_i64x2_splat(INT64_MIN))};
+}
+inline f64x2 select_gt(f64x2 a, f64x2 b, f64x2 t, f64x2 f) {
+    return {wasm_v128_bitselect(t.v, f.v, wasm_f64x2_gt(a.v, b.v))};
+}
+// 指数部を直接組み立てて 2^n を作る (n は整数値、-1022 <= n <= 1023)。
+// n + 1.5·2^52 の下位ビットが n の 2 の補数表現になることを使う
+inline f64x2 pow2i(f64x2 n) {
+    v128_t bits = wasm_f64x2_add(n.v, wasm_f64x2_splat(6755399441055744.0));
+    return {wasm_i64x2_shl(wasm_i64x2_add(bits, wasm_i64x2_splat(1023)), 52)};
+}
+#elif defined(__SSE2__)
+struct f64x2 { __m128d v; };
+inline f64x2 load(const double* p) { return {_mm_loadu_pd(p)}; }
+inline void store(double* p, f64x2 a) { _mm_storeu_pd(p, a.v); }
+inline f64x2 splat(double x) { return {_mm_set1_pd(x)}; }
+inline f64x2 make(double lo, double hi) { return {_mm_set_pd(hi, lo)}; }
+inline double lane0(f64x2 a) { return _mm_cvtsd_f64(a.v); }
+inline double lane1(f64x2 a) { return _mm_cvtsd_f64(_mm_unpackhi_pd(a.v, a.v)); }
+inline f64x2 operator+(f64x2 a, f64x2 b) { return {_mm_add_pd(a.v, b.v)}; }
+inline f64x2 operator-(f64x2 a, f64x2 b) { return {_mm_sub_pd(a.v, b.v)}; }
+inline f64x2 operator*(f64x2 a, f64x2 b) { return {_mm_mul_pd(a.v, b.v)}; }
+inline f64x2 operator/(f64x2 a, f64x2 b) { return {_mm_div_pd(a.v, b.v)}; }
+// maxpd/minpd は等値や NaN のとき第 2 オペランドを返すので、引数を入れ替えて std::max/std::min に合わせる
+inline f64x2 max(f64x2 a, f64x2 b) { return {_mm_max_pd(b.v, a.v)}; }
+inline f64x2 min(f64x2 a, f64x2 b) { return {_mm_min_pd(b.v, a.v)}; }
+inline f64x2 abs(f64x2 a) { return {_mm_andnot_pd(_mm_set1_pd(-0.0), a.v)}; }
+inline f64x2 copysign(f64x2 mag, f64x2 sgn) {
+    __m128d m = _mm_set1_pd(-0.0);
+    return {_mm_or_pd(_mm_andnot_pd(m, mag.v), _mm_and_pd(m, sgn.v))};
+}
+inline f64x2 select_gt(f64x2 a, f64x2 b, f64x2 t, f64x2 f) {
+    __m128d m = _mm_cmpgt_pd(a.v, b.v);
+    return {_mm_or_pd(_mm_and_pd(m, t.v), _mm_andnot_pd(m, f.v))};
+}
+inline f64x2 pow2i(f64x2 n) {
+    __m128i bits = _mm_castpd_si128(_mm_add_pd(n.v, _mm_set1_pd(6755399441055744.0)));
+    return {_mm_castsi128_pd(_mm_slli_epi64(_mm_add_epi64(bits, _mm_set1_epi64x(1023)), 52))};
+}
+#else
+struct f64x2 { double v[2]; };
+inline f64x2 load(const double* p) { return {{p[0], p[1]}}; }
+inline void store(double* p, f64x2 a) { p[0] = a.v[0]; p[1] = a.v[1]; }
+inline f64x2 splat(double x) { return {{x, x}}; }
+inline f64x2 make(double lo, double hi) { return {{lo, hi}}; }
+inline double lane0(f64x2 a) { return a.v[0]; }
+inline double lane1(f64x2 a) { return a.v[1]; }
+inline f64x2 operator+(f64x2 a, f64x2 b) { return {{a.v[0] + b.v[0], a.v[1] + b.v[1]}}; }
+inline f64x2 operator-(f64x2 a, f64x2 b) { return {{a.v[0] - b.v[0], a.v[1] - b.v[1]}}; }
+inline f64x2 operator*(f64x2 a, f64x2 b) { return {{a.v[0] * b.v[0], a.v[1] * b.v[1]}}; }
+inline f64x2 operator/(f64x2 a, f64x2 b) { return {{a.v[0] / b.v[0], a.v[1] / b.v[1]}}; }
+inline f64x2 max(f64x2 a, f64x2 b) { return {{a.v[0] < b.v[0] ? b.v[0] : a.v[0], a.v[1] < b.v[1] ? b.v[1] : a.v[1]}}; }
+inline f64x2 min(f64x2 a, f64x2 b) { return {{b.v[0] < a.v[0] ? b.v[0] : a.v[0], b.v[1] < a.v[1] ? b.v[1] : a.v[1]}}; }
+inline f64x2 abs(f64x2 a) { return {{std::fabs(a.v[0]), std::fabs(a.v[1])}}; }
+inline f64x2 copysign(f64x2 mag, f64x2 sgn) { return {{std::copysign(mag.v[0], sgn.v[0]), std::copysign(mag.v[1], sgn.v[1])}}; }
+inline f64x2 select_gt(f64x2 a, f64x2 b, f64x2 t, f64x2 f) {
+    return {{a.v[0] > b.v[0] ? t.v[0] : f.v[0], a.v[1] > b.v[1] ? t.v[1] : f.v[1]}};
+}
+inline f64x2 pow2i(f64x2 n) {
+    f64x2 r;
+    for (int k = 0; k < 2; ++k) {
+        uint64_t bits = static_cast<uint64_t>(static_cast<int64_t>(n.v[k]) + 1023) << 52;
+        std::memcpy(&r.v[k], &bits, sizeof(double));
+    }
+    return r;
+}
+#endif
+
+inline f64x2& operator+=(f64x2& a, f64x2 b) { return a = a + b; }
+inline double hsum(f64x2 a) { return lane0(a) + lane1(a); }
+
+// exp(x) (-700 <= x <= 0)。x = n·ln2 + r (|r| <= ln2/2) に分け、exp(r) を 13 次のテイラー多項式で
+// 近似する (相対誤差 ~1e-16)。呼び出し側で範囲を保証し、libm を呼ばずにベクトルのまま計算する
+inline f64x2 exp_nonpos(f64x2 x) {
+    const f64x2 magic = splat(6755399441055744.0);
+    f64x2 n = (x * splat(1.4426950408889634) + magic) - magic; // 最近接整数への丸め
+    f64x2 r = (x - n * splat(6.93147180369123816490e-01)) - n * splat(1.90821492927058770002e-10);
+    f64x2 p = splat(1.0 / 6227020800.0);
+    const double inv_fact[13] = {1.0 / 479001600.0, 1.0 / 39916800.0, 1.0 / 3628800.0, 1.0 / 362880.0, 1.0 / 40320.0,
+                                 1.0 / 5040.0, 1.0 / 720.0, 1.0 / 120.0, 1.0 / 24.0, 1.0 / 6.0, 0.5, 1.0, 1.0};
+    for (double c : inv_fact) p = p * r + splat(c);
+    return p * pow2i(n);
+}
+
+// log1p(e) (0 <= e <= 1)。fdlibm の log1p と同じ有理近似で、1 + e > √2 のときは (1 + e)/2 に縮約する
+inline f64x2 log1p_unit(f64x2 e) {
+    const f64x2 one = splat(1.0), half = splat(0.5);
+    f64x2 k = select_gt(e, splat(0.41421356237309503), one, splat(0.0));
+    f64x2 f = select_gt(e, splat(0.41421356237309503), (e - one) * half, e);
+    f64x2 s = f / (splat(2.0) + f);
+    f64x2 z = s * s, w = z * z;
+    f64x2 t1 = w * (splat(3.999999999940941908e-01) + w * (splat(2.222219843214978396e-01) + w * splat(1.531383769920937332e-01)));
+    f64x2 t2 = z * (splat(6.666666666666735130e-01) + w * (splat(2.857142874366239149e-01) + w * (splat(1.818357216161805012e-01) + w * splat(1.479819860511658591e-01))));
+    f64x2 R = t2 + t1;
+    f64x2 hfsq = half * f * f;
+    return k * splat(6.93147180369123816490e-01) - ((hfsq - (s * (hfsq + R) + k * splat(1.90821492927058770002e-10))) - f);
+}
+
+} // namespace simd
+} // namespace utils
+
+#endif
@@ -0,0 +1,51 @@
+#include "spectrum.hpp"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace utils {
+
+Spectrum::Spectrum(int width, int height) {
+    // DenoiseEngine::eigenvalues() と同じ式で 1 次元成分を求める (和はビット単位で一致する)
+    std::vector<double> a(width), b(height);
+    for (int x = 0; x < width; ++x) a[x] = 4.0 * pow(sin(M_PI * x / (2.0 * width)), 2.0);
+    for (int y = 0; y < height; ++y) b[y] = 4.0 * pow(sin(M_PI * y / (2.0 * height)), 2.0);
+
+    std::vector<double> all;
+    all.reserve(static_cast<std::size_t>(width) * height);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) all.push_back(a[x] + b[y]);
+    }
+    std::sort(all.begin(), all.end());
+    for (std::size_t i = 0; i < all.size();) {
+        std::size_t j = i;
+        while (j < all.size() && all[j] == all[i]) ++j;
+        values.push_back(all[i]);
+        counts.push_back(static_cast<double>(j - i));
+        i = j;
+    }
+}
+
+std::shared_ptr<const Spectrum> Spectrum::get(int width, int height) {
+    // 重複が見込めるのは正方形だけ (異なる値は w(w+1)/2 = n/2 + w/2)。それ以外は並べ替えの手間も省く
+    if (width != height) return nullptr;
+    static std::mutex mtx;
+    static std::map<std::pair<int, int>, std::weak_ptr<const Spectrum>> cache;
+    std::lock_guard<std::mutex> lock(mtx);
+    // 使われなくなったサイズの項目はここで取り除く (大量の異なるサイズを処理しても増え続けない)
+    for (auto it = cache.begin(); it != cache.end();) {
+        if (it->second.expired()) it = cache.erase(it);
+        else ++it;
+    }
+    auto& slot = cache[{width, height}];
+    std::shared_ptr<const Spectrum> spec = slot.lock();
+    if (!spec) {
+        spec = std::make_shared<const Spectrum>(width, height);
+        slot = spec;
+    }
+    return spec;
+}
+
+} // namespace utils
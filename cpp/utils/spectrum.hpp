@@ -0,0 +1,37 @@
+#ifndef SPECTRUM_HPP
+#define SPECTRUM_HPP
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace utils {
+
+// Neumann ラプラシアン固有値 φ(x,y) = a(x) + b(y) の重複を畳み込んだ要約
+// w == h では φ(x,y) = φ(y,x) なので異なる値は約半分になる。値が完全に一致するものだけを
+// まとめるため、Σ_i f(φ_i) = Σ_k count_k f(value_k) は画素ごとの和と (加算順序を除き) 一致する。
+// w != h ではほとんど重複しない (24x17 で 408 値すべてが異なる) ので要約は作らない
+class Spectrum {
+public:
+    Spectrum(int width, int height);
+
+    // 画像サイズごとに共有する要約を取得する。畳み込んでも値の数が半分程度まで減らないサイズでは nullptr
+    // (呼び出し側は固有値を直接たどる)。キャッシュは弱参照なので、使うエンジンがなくなれば解放される
+    static std::shared_ptr<const Spectrum> get(int width, int height);
+
+    // f(value, count) を異なる固有値ごとに 1 回ずつ呼ぶ
+    template <class F>
+    void for_each(F f) const {
+        for (std::size_t k = 0; k < values.size(); ++k) f(values[k], counts[k]);
+    }
+
+    std::size_t size() const { return values.size(); }
+
+private:
+    std::vector<double> values;
+    std::vector<double> counts;
+};
+
+} // namespace utils
+
+#endif
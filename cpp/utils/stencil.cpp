@@ -0,0 +1,170 @@
+#include "stencil.hpp"
+
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define DENOISE_X86_DISPATCH 1
+#endif
+
+namespace utils {
+
+namespace {
+
+// 行内の更新は常に ((左 + 右) + 上) + 下 の順で足し合わせる。カーネルはプロセス内で
+// 一度だけ選ばれるので、同じマシン上では結果がスレッド数や行分割に依存しない
+template <class T>
+using RowKernel = void (*)(T*, const T*, int, int, T, T, T);
+
+template <class T>
+void rb_row_scalar(T* row, const T* brow, int w, int parity, T b_scale, T alpha, T inv4) {
+    int start = (parity == 1) ? 1 : 2;
+    for (int px = start; px < w - 1; px += 2) {
+        row[px] = (brow[px] * b_scale + alpha * (row[px - 1] + row[px + 1] + row[px - w] + row[px + w])) * inv4;
+    }
+}
+
+#if defined(__wasm_simd128__)
+// 同色の 2 画素 (px, px+2) を 1 レーンずつ処理する。近傍はシャッフルで集める
+void rb_row_simd128(double* row, const double* brow, int w, int parity, double b_scale, double alpha, double inv4) {
+    int px = (parity == 1) ? 1 : 2;
+    v128_t vs = wasm_f64x2_splat(b_scale), va = wasm_f64x2_splat(alpha), vi = wasm_f64x2_splat(inv4);
+    // c2 は row[px+3], row[px+4] を読む。px + 4 < w に限ることで次の行 (他のスレッドが書き込む) に掛からない
+    for (; px + 4 < w; px += 4) {
+        v128_t c0 = wasm_v128_load(row + px - 1), c1 = wasm_v128_load(row + px + 1), c2 = wasm_v128_load(row + px + 3);
+        v128_t left = wasm_i64x2_shuffle(c0, c1, 0, 2), right = wasm_i64x2_shuffle(c1, c2, 0, 2);
+        // 上下の行は他色の画素だけを読む (同色の画素は隣接行のスレッドが同じ半スイープで書き込む)
+        v128_t up = wasm_f64x2_make(row[px - w], row[px - w + 2]), down = wasm_f64x2_make(row[px + w], row[px + w + 2]);
+        v128_t b0 = wasm_v128_load(brow + px), b1 = wasm_v128_load(brow + px + 2);
+        v128_t bb = wasm_i64x2_shuffle(b0, b1, 0, 2);
+        v128_t sum = wasm_f64x2_add(wasm_f64x2_add(wasm_f64x2_add(left, right), up), down);
+        v128_t val = wasm_f64x2_mul(wasm_f64x2_add(wasm_f64x2_mul(bb, vs), wasm_f64x2_mul(va, sum)), vi);
+        wasm_v128_store64_lane(row + px, val, 0);
+        wasm_v128_store64_lane(row + px + 2, val, 1);
+    }
+    for (; px < w - 1; px += 2) {
+        row[px] = (brow[px] * b_scale + alpha * (row[px - 1] + row[px + 1] + row[px - w] + row[px + w])) * inv4;
+    }
+}
+#endif
+
+#if defined(DENOISE_X86_DISPATCH)
+// 連続 4 画素をまとめて計算し、対象色のレーンだけをマスク付きで書き戻す (他色の画素には書き込まない)。
+// 上下の行は対象色のレーンだけをマスク付きで読む。全幅で読むと、対象外のレーンが隣接行の同色画素
+// (同じ半スイープで他のスレッドが書き込む) に触れてデータ競合になる。左右は自分の行なので全幅でよい
+__attribute__((target("avx2")))
+void rb_row_avx2(double* row, const double* brow, int w, int parity, double b_scale, double alpha, double inv4) {
+    __m256d vs = _mm256_set1_pd(b_scale), va = _mm256_set1_pd(alpha), vi = _mm256_set1_pd(inv4);
+    // px が偶数のときレーン k の画素の偶奇は k と一致する
+    __m256i mask = (parity == 0) ? _mm256_set_epi64x(0, -1, 0, -1) : _mm256_set_epi64x(-1, 0, -1, 0);
+    int px = 2;
+    for (; px + 4 < w; px += 4) {
+        __m256d left = _mm256_loadu_pd(row + px - 1), right = _mm256_loadu_pd(row + px + 1);
+        __m256d up = _mm256_maskload_pd(row + px - w, mask), down = _mm256_maskload_pd(row + px + w, mask);
+        __m256d sum = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(left, right), up), down);
+        __m256d val = _mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(brow + px), vs), _mm256_mul_pd(va, sum)), vi);
+        _mm256_maskstore_pd(row + px, mask, val);
+    }
+    if (parity == 1) row[1] = (brow[1] * b_scale + alpha * (row[0] + row[2] + row[1 - w] + row[1 + w])) * inv4;
+    for (int q = px + ((px & 1) != parity ? 1 : 0); q < w - 1; q += 2) {
+        row[q] = (brow[q] * b_scale + alpha * (row[q - 1] + row[q + 1] + row[q - w] + row[q + w])) * inv4;
+    }
+}
+
+__attribute__((target("avx512f")))
+void rb_row_avx512(double* row, const double* brow, int w, int parity, double b_scale, double alpha, double inv4) {
+    __m512d vs = _mm512_set1_pd(b_scale), va = _mm512_set1_pd(alpha), vi = _mm512_set1_pd(inv4);
+    __mmask8 mask = (parity == 0) ? 0x55 : 0xAA;
+    int px = 2;
+    for (; px + 8 < w; px += 8) {
+        __m512d left = _mm512_loadu_pd(row + px - 1), right = _mm512_loadu_pd(row + px + 1);
+        __m512d up = _mm512_maskz_loadu_pd(mask, row + px - w), down = _mm512_maskz_loadu_pd(mask, row + px + w);
+        __m512d sum = _mm512_add_pd(_mm512_add_pd(_mm512_add_pd(left, right), up), down);
+        __m512d val = _mm512_mul_pd(_mm512_add_pd(_mm512_mul_pd(_mm512_loadu_pd(brow + px), vs), _mm512_mul_pd(va, sum)), vi);
+        _mm512_mask_storeu_pd(row + px, mask, val);
+    }
+    if (parity == 1) row[1] = (brow[1] * b_scale + alpha * (row[0] + row[2] + row[1 - w] + row[1 + w])) * inv4;
+    for (int q = px + ((px & 1) != parity ? 1 : 0); q < w - 1; q += 2) {
+        row[q] = (brow[q] * b_scale + alpha * (row[q - 1] + row[q + 1] + row[q - w] + row[q + w])) * inv4;
+    }
+}
+
+// 単精度版。1 レジスタに 8 画素 (AVX2) / 16 画素 (AVX-512) を載せる
+__attribute__((target("avx2")))
+void rb_row_avx2_f32(float* row, const float* brow, int w, int parity, float b_scale, float alpha, float inv4) {
+    __m256 vs = _mm256_set1_ps(b_scale), va = _mm256_set1_ps(alpha), vi = _mm256_set1_ps(inv4);
+    __m256i mask = (parity == 0) ? _mm256_set_epi32(0, -1, 0, -1, 0, -1, 0, -1) : _mm256_set_epi32(-1, 0, -1, 0, -1, 0, -1, 0);
+    int px = 2;
+    for (; px + 8 < w; px += 8) {
+        __m256 left = _mm256_loadu_ps(row + px - 1), right = _mm256_loadu_ps(row + px + 1);
+        __m256 up = _mm256_maskload_ps(row + px - w, mask), down = _mm256_maskload_ps(row + px + w, mask);
+        __m256 sum = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(left, right), up), down);
+        __m256 val = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(brow + px), vs), _mm256_mul_ps(va, sum)), vi);
+        _mm256_maskstore_ps(row + px, mask, val);
+    }
+    if (parity == 1) row[1] = (brow[1] * b_scale + alpha * (row[0] + row[2] + row[1 - w] + row[1 + w])) * inv4;
+    for (int q = px + ((px & 1) != parity ? 1 : 0); q < w - 1; q += 2) {
+        row[q] = (brow[q] * b_scale + alpha * (row[q - 1] + row[q + 1] + row[q - w] + row[q + w])) * inv4;
+    }
+}
+
+__attribute__((target("avx512f")))
+void rb_row_avx512_f32(float* row, const float* brow, int w, int parity, float b_scale, float alpha, float inv4) {
+    __m512 vs = _mm512_set1_ps(b_scale), va = _mm512_set1_ps(alpha), vi = _mm512_set1_ps(inv4);
+    __mmask16 mask = (parity == 0) ? 0x5555 : 0xAAAA;
+    int px = 2;
+    for (; px + 16 < w; px += 16) {
+        __m512 left = _mm512_loadu_ps(row + px - 1), right = _mm512_loadu_ps(row + px + 1);
+        __m512 up = _mm512_maskz_loadu_ps(mask, row + px - w), down = _mm512_maskz_loadu_ps(mask, row + px + w);
+        __m512 sum = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(left, right), up), down);
+        __m512 val = _mm512_mul_ps(_mm512_add_ps(_mm512_mul_ps(_mm512_loadu_ps(brow + px), vs), _mm512_mul_ps(va, sum)), vi);
+        _mm512_mask_storeu_ps(row + px, mask, val);
+    }
+    if (parity == 1) row[1] = (brow[1] * b_scale + alpha * (row[0] + row[2] + row[1 - w] + row[1 + w])) * inv4;
+    for (int q = px + ((px & 1) != parity ? 1 : 0); q < w - 1; q += 2) {
+        row[q] = (brow[q] * b_scale + alpha * (row[q - 1] + row[q + 1] + row[q - w] + row[q + w])) * inv4;
+    }
+}
+#endif
+
+RowKernel<double> select_rb_kernel() {
+#if defined(__wasm_simd128__)
+    return rb_row_simd128;
+#elif defined(DENOISE_X86_DISPATCH)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return rb_row_avx512;
+    if (__builtin_cpu_supports("avx2")) return rb_row_avx2;
+    return rb_row_scalar<double>;
+#else
+    return rb_row_scalar<double>;
+#endif
+}
+
+// 単精度の WASM 版はスカラーのまま (自動ベクトル化に任せる)
+RowKernel<float> select_rb_kernel_f32() {
+#if defined(DENOISE_X86_DISPATCH)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return rb_row_avx512_f32;
+    if (__builtin_cpu_supports("avx2")) return rb_row_avx2_f32;
+#endif
+    return rb_row_scalar<float>;
+}
+
+const RowKernel<double> rb_kernel = select_rb_kernel();
+const RowKernel<float> rb_kernel_f32 = select_rb_kernel_f32();
+
+} // namespace
+
+void relax_interior_red_black(const ScreenedPoisson& op, double* x, const double* b, int w, int y, int parity) {
+    long long offset = static_cast<long long>(y) * w;
+    rb_kernel(x + offset, b + offset, w, parity, op.b_scale, op.alpha, op.inv_denom[4]);
+}
+
+void relax_interior_red_black(const ScreenedPoisson& op, float* x, const float* b, int w, int y, int parity) {
+    long long offset = static_cast<long long>(y) * w;
+    rb_kernel_f32(x + offset, b + offset, w, parity, static_cast<float>(op.b_scale), static_cast<float>(op.alpha), static_cast<float>(op.inv_denom[4]));
+}
+
+} // namespace utils
@@ -0,0 +1,91 @@
+#ifndef STENCIL_HPP
+#define STENCIL_HPP
+
+#include <vector>
+#include "core.hpp"
+#include "thread_pool.hpp"
+
+namespace utils {
+
+// 5 点ステンシルのガウス・ザイデル更新 x_i = (b_i·b_scale + α Σ_j x_j) / (c + α·nbrs)
+// GMRF の MAP、HGMRF のバイアス w、rTV-MRF の x-step がこの形を共有する
+struct ScreenedPoisson {
+    double alpha;
+    double b_scale;
+    double inv_denom[5]; // 近傍数ごとの 1/(c + α·nbrs)
+
+    ScreenedPoisson(double c, double alpha_, double b_scale_ = 1.0) : alpha(alpha_), b_scale(b_scale_) {
+        for (int nbr = 0; nbr <= 4; ++nbr) inv_denom[nbr] = 1.0 / safe_denom(c + alpha * nbr);
+    }
+
+    // 境界判定付きの汎用更新 (外周画素用)。単精度の作業領域でも係数と和は double で計算する
+    template <class T>
+    inline void update(std::vector<T>& x, const std::vector<T>& b, int px, int py, int w, int h) const {
+        int i = py * w + px;
+        double sum = 0.0; int neighbors = 0;
+        if (px > 0) { sum += x[i - 1]; neighbors++; }
+        if (px < w - 1) { sum += x[i + 1]; neighbors++; }
+        if (py > 0) { sum += x[i - w]; neighbors++; }
+        if (py < h - 1) { sum += x[i + w]; neighbors++; }
+        x[i] = static_cast<T>((b[i] * b_scale + alpha * sum) * inv_denom[neighbors]);
+    }
+};
+
+// 内部行 (1 <= y <= h-2) の x ∈ [1, w-2] のうち偶奇が parity の画素を境界分岐なしで更新する。
+// 同色画素は互いに独立なので SIMD 化できる (AVX-512/AVX2 は実行時 CPU 判定、WASM は SIMD128)
+// 単精度版は係数も単精度に丸めて同じ式で更新する (1 レジスタの画素数が倍になり、帯域も半分になる)
+void relax_interior_red_black(const ScreenedPoisson& op, double* x, const double* b, int w, int y, int parity);
+void relax_interior_red_black(const ScreenedPoisson& op, float* x, const float* b, int w, int y, int parity);
+
+// 同じ内部区間の辞書式更新。左隣の更新結果に依存するためスカラーだが分岐は持たない
+template <class T>
+inline void relax_interior_lexicographic(const ScreenedPoisson& op, T* x, const T* b, int w, int y) {
+    T* row = x + static_cast<long long>(y) * w;
+    const T* brow = b + static_cast<long long>(y) * w;
+    T alpha = static_cast<T>(op.alpha), b_scale = static_cast<T>(op.b_scale), inv4 = static_cast<T>(op.inv_denom[4]);
+    for (int px = 1; px < w - 1; ++px) {
+        row[px] = (brow[px] * b_scale + alpha * (row[px - 1] + row[px + 1] + row[px - w] + row[px + w])) * inv4;
+    }
+}
+
+// 辞書式順序の 1 スイープ (論文の既定)。外周の行と列だけ汎用更新を使う
+template <class T>
+inline void sweep_lexicographic(const ScreenedPoisson& op, std::vector<T>& x, const std::vector<T>& b, int w, int h) {
+    for (int y = 0; y < h; ++y) {
+        if (y == 0 || y == h - 1 || w < 3) {
+            for (int px = 0; px < w; ++px) op.update(x, b, px, y, w, h);
+            continue;
+        }
+        op.update(x, b, 0, y, w, h);
+        relax_interior_lexicographic(op, x.data(), b.data(), w, y);
+        op.update(x, b, w - 1, y, w, h);
+    }
+}
+
+// 赤黒 (市松) 順序の 1 スイープ。同色の画素は互いに独立なので、各半スイープを
+// 行バンドに分けて並列化しても結果はスレッド数に依存しない
+template <class RowUpdate>
+inline void sweep_red_black_rows(ThreadPool& pool, int h, RowUpdate row_update) {
+    for (int color = 0; color < 2; ++color) {
+        pool.parallel_for(0, h, [&](int y0, int y1) {
+            for (int y = y0; y < y1; ++y) row_update(y, (y + color) & 1);
+        });
+    }
+}
+
+template <class T>
+inline void sweep_red_black(const ScreenedPoisson& op, std::vector<T>& x, const std::vector<T>& b, int w, int h, ThreadPool& pool) {
+    sweep_red_black_rows(pool, h, [&](int y, int x0) {
+        if (y == 0 || y == h - 1 || w < 3) {
+            for (int px = x0; px < w; px += 2) op.update(x, b, px, y, w, h);
+            return;
+        }
+        if (x0 == 0) op.update(x, b, 0, y, w, h);
+        relax_interior_red_black(op, x.data(), b.data(), w, y, x0);
+        if (((w - 1) & 1) == x0) op.update(x, b, w - 1, y, w, h);
+    });
+}
+
+} // namespace utils
+
+#endif
@@ -0,0 +1,74 @@
+#include "task_scheduler.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+
+namespace utils {
+
+TaskScheduler::TaskScheduler(int threads) {
+    int total = threads > 0 ? threads : ThreadPool::default_threads();
+#if !DENOISE_HAS_THREADS
+    total = 1;
+#endif
+    for (int t = 0; t < total; ++t) queues.push_back(std::make_unique<Queue>());
+    for (int t = 0; t < total; ++t) workers.emplace_back(&TaskScheduler::worker_loop, this, t);
+}
+
+TaskScheduler::~TaskScheduler() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    cv_work.notify_all();
+    for (auto& th : workers) th.join();
+}
+
+void TaskScheduler::submit(std::function<void()> task) {
+    Queue& q = *queues[next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size()];
+    {
+        std::lock_guard<std::mutex> lock(q.mtx);
+        q.tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        ++queued; ++unfinished;
+    }
+    cv_work.notify_one();
+}
+
+void TaskScheduler::wait() {
+    std::unique_lock<std::mutex> lock(mtx);
+    cv_done.wait(lock, [&] { return unfinished == 0; });
+}
+
+// 自分のキューの末尾、なければ隣のワーカーから順に先頭を盗む
+bool TaskScheduler::try_pop(int id, std::function<void()>& task) {
+    int count = static_cast<int>(queues.size());
+    for (int k = 0; k < count; ++k) {
+        Queue& q = *queues[(id + k) % count];
+        std::lock_guard<std::mutex> lock(q.mtx);
+        if (q.tasks.empty()) continue;
+        if (k == 0) { task = std::move(q.tasks.back()); q.tasks.pop_back(); }
+        else { task = std::move(q.tasks.front()); q.tasks.pop_front(); }
+        return true;
+    }
+    return false;
+}
+
+void TaskScheduler::worker_loop(int id) {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv_work.wait(lock, [&] { return stopping || queued > 0; });
+            if (queued == 0) return; // stopping かつ残りなし
+            --queued; // 取り出す 1 件を予約する (キューへの追加は queued の加算より先なので必ず見つかる)
+        }
+        std::function<void()> task;
+        while (!try_pop(id, task)) std::this_thread::yield();
+        task();
+        std::lock_guard<std::mutex> lock(mtx);
+        if (--unfinished == 0) cv_done.notify_all();
+    }
+}
+
+} // namespace utils
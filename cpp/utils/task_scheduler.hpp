@@ -0,0 +1,52 @@
+#ifndef TASK_SCHEDULER_HPP
+#define TASK_SCHEDULER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace utils {
+
+// 独立したジョブ (画像 1 枚の復元など) を流すワークスティーリング型スケジューラ
+// ジョブはワーカーごとの両端キューに順に振り分け、各ワーカーは自分のキューの末尾から取り出す。
+// 自分のキューが空になったら他のワーカーのキューの先頭から盗むので、所要時間がばらつくジョブでも偏らない。
+// ThreadPool (fork-join) と違い、ジョブの投入と実行は並行してよい
+class TaskScheduler {
+public:
+    explicit TaskScheduler(int threads = 0); // 0: ハードウェアの論理コア数
+    ~TaskScheduler(); // 残っているジョブを実行し終えてから停止する
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    int size() const { return static_cast<int>(workers.size()); }
+    void submit(std::function<void()> task);
+    // 投入済みのジョブがすべて終わるまで待つ (ジョブが投げた例外は呼び出し側で捕捉しておくこと)
+    void wait();
+
+private:
+    struct Queue {
+        std::mutex mtx;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void worker_loop(int id);
+    bool try_pop(int id, std::function<void()>& task);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<unsigned> next_queue{0};
+    std::mutex mtx;
+    std::condition_variable cv_work, cv_done;
+    long queued = 0;     // キューに残っているジョブ数 (mtx で保護)
+    long unfinished = 0; // 投入済みで未完了のジョブ数 (mtx で保護)
+    bool stopping = false;
+};
+
+} // namespace utils
+
+#endif
@@ -0,0 +1,76 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+
+namespace utils {
+
+int ThreadPool::default_threads() {
+#if DENOISE_HAS_THREADS
+    return std::max(1u, std::thread::hardware_concurrency());
+#else
+    return 1;
+#endif
+}
+
+ThreadPool::ThreadPool(int threads) {
+    int total = threads > 0 ? threads : default_threads();
+#if !DENOISE_HAS_THREADS
+    total = 1;
+#endif
+    for (int t = 1; t < total; ++t) workers.emplace_back(&ThreadPool::worker_loop, this, t);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    cv_start.notify_all();
+    for (auto& th : workers) th.join();
+}
+
+void ThreadPool::worker_loop(int id) {
+    unsigned long seen = 0;
+    while (true) {
+        const std::function<void(int, int)>* fn;
+        int b, e;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv_start.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            if (id >= job_chunks) continue;
+            fn = job;
+            long long range = job_end - job_begin;
+            b = job_begin + static_cast<int>(range * id / job_chunks);
+            e = job_begin + static_cast<int>(range * (id + 1) / job_chunks);
+        }
+        (*fn)(b, e);
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (--pending == 0) cv_done.notify_one();
+        }
+    }
+}
+
+void ThreadPool::parallel_for(int begin, int end, const std::function<void(int, int)>& fn) {
+    int range = end - begin;
+    if (range <= 0) return;
+    int chunks = std::min(size(), range);
+    if (chunks == 1) {
+        fn(begin, end);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        job = &fn;
+        job_begin = begin; job_end = end; job_chunks = chunks;
+        pending = chunks - 1;
+        ++generation;
+    }
+    cv_start.notify_all();
+    fn(begin, begin + static_cast<int>(static_cast<long long>(range) / chunks));
+    std::unique_lock<std::mutex> lock(mtx);
+    cv_done.wait(lock, [&] { return pending == 0; });
+}
+
+} // namespace utils
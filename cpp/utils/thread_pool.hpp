@@ -0,0 +1,49 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <functional>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// pthread を有効にしていない Emscripten ビルドではスレッドを生成できない
+#if !defined(__EMSCRIPTEN__) || defined(__EMSCRIPTEN_PTHREADS__)
+#define DENOISE_HAS_THREADS 1
+#else
+#define DENOISE_HAS_THREADS 0
+#endif
+
+namespace utils {
+
+// fork-join 型の固定サイズスレッドプール
+// parallel_for は範囲をスレッド数で等分した連続ブロック (行バンド) に割り当て、
+// 呼び出しスレッドも 1 ブロックを担当して全ブロックの完了まで待つ
+class ThreadPool {
+public:
+    explicit ThreadPool(int threads = 0); // 0: ハードウェアの論理コア数
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return static_cast<int>(workers.size()) + 1; }
+    void parallel_for(int begin, int end, const std::function<void(int, int)>& fn);
+
+    static int default_threads();
+
+private:
+    void worker_loop(int id);
+
+    std::vector<std::thread> workers;
+    std::mutex mtx;
+    std::condition_variable cv_start, cv_done;
+    const std::function<void(int, int)>* job = nullptr;
+    int job_begin = 0, job_end = 0, job_chunks = 0;
+    int pending = 0;
+    unsigned long generation = 0;
+    bool stopping = false;
+};
+
+} // namespace utils
+
+#endif
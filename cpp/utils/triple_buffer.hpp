@@ -0,0 +1,43 @@
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+
+#include <atomic>
+
+namespace utils {
+
+// 単一生産者・単一消費者のロックフリー三重バッファ
+// 生産者は back() に書いて publish() で差し替え、消費者は acquire() で最新の 1 枚を front() に取り出す。
+// 消費者が追いつかない間に publish された古いスナップショットは上書きされて捨てられる
+template <class T>
+class TripleBuffer {
+public:
+    T& back() { return slots[back_index]; }
+    T& front() { return slots[front_index]; }
+
+    void publish() {
+        int prev = state.exchange(back_index | kDirty, std::memory_order_acq_rel);
+        back_index = prev & kIndex;
+    }
+
+    bool has_new() const { return (state.load(std::memory_order_acquire) & kDirty) != 0; }
+
+    // 新しいスナップショットがあれば front() と入れ替えて true を返す
+    bool acquire() {
+        if (!has_new()) return false;
+        int prev = state.exchange(front_index, std::memory_order_acq_rel);
+        front_index = prev & kIndex;
+        return true;
+    }
+
+private:
+    static constexpr int kIndex = 3;
+    static constexpr int kDirty = 4;
+
+    T slots[3];
+    std::atomic<int> state{1}; // 受け渡し中のスロット番号 + 未読フラグ
+    int back_index = 0, front_index = 2;
+};
+
+} // namespace utils
+
+#endif
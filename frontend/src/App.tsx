@@ -81,6 +81,7 @@ const App: React.FC = () => {
         setMetrics(prev => [...prev, data]);
         setProgress(Math.round((data.iteration / (allParams[algorithm].max_iter || 50)) * 100));
         if (image && mode === 'single') renderResult(image, setDenoisedUrl);
+        if (heatmap && mode === 'single') renderResult(heatmap, setHeatmapUrl, true);
       } else if (type === 'done') {
         if (mode === 'single') {
           renderResult(data, setDenoisedUrl);
@@ -56,7 +56,8 @@ export const PARAM_HELP: Record<string, string> = {
   'gamma_sq': 'HGMRF/rTV-MRFの補助変数緩和パラメータ (γ²)。',
   's': 'LC-MRFの活性化鋭度 (s)。',
   'max_iter': '最大反復回数 (Iterations)。',
-  'epsilon_map': 'MAP推定の更新ステップ幅 (ε_map)。',
+  'epsilon_map': 'MAP推定の更新ステップ幅 (ε_map)。加速法では初期ステップ幅。',
+  'map_optimizer': 'LC-MRFのMAP推定法 (0: 勾配降下法, 1: Nesterov加速勾配法 (直線探索付き))。',
   'epsilon_pri': '事前分布サンプリングの歩幅 (ε_pri)。',
   'epsilon_post': '事後分布サンプリングの歩幅 (ε_post)。',
   'eta_lambda': 'λ の推定学習率 (η_λ)。',
@@ -64,26 +65,31 @@ export const PARAM_HELP: Record<string, string> = {
   'eta_sigma2': 'σ² の推定学習率 (η_σ²)。',
   'eta_gamma2': 'γ² の推定学習率 (η_γ²)。',
   'is_learning': '周辺尤度最大化によるパラメータ推定の実行有無。',
-  'verify_likelihood': '尤度推移の監視モード。'
+  'verify_likelihood': '尤度推移の監視モード。',
+  'solver': 'MAP推定ソルバ (0: ガウス・ザイデル法, 1: DCTによる厳密解, 2: マルチグリッド法, 3: 赤黒ガウス・ザイデル法 (並列))。',
+  'tv_solver': 'rTV-MRFの最適化法 (0: split-Bregman法, 1: Chambolle-Pock主双対法 (並列))。',
+  'persistent_chains': 'サンプリング連鎖を反復間で持ち越す (持続的コントラスティブ・ダイバージェンス)。',
+  'seed': 'MALA連鎖の乱数シード。',
+  'precision': '作業領域の精度 (0: 倍精度, 1: 混合精度 (GMRFの反復とLC-MRFのサンプリング連鎖をfloatで保持し、総和は倍精度))。'
 };
 
 export const THESIS_DEFAULTS: Record<string, any> = {
   'GMRF': { 
     lambda: 1e-7, alpha: 1e-4, sigma_sq: 1000.0, max_iter: 50, is_learning: true,
-    eta_lambda: 1e-12, eta_alpha: 5e-7
+    eta_lambda: 1e-12, eta_alpha: 5e-7, solver: 0, precision: 0
   },
   'HGMRF': { 
     lambda: 1e-7, alpha: 1e-4, sigma_sq: 1000.0, gamma_sq: 1e-3, max_iter: 100, is_learning: true,
-    eta_lambda: 1e-12, eta_alpha: 5e-8, eta_gamma2: 5e-8, verify_likelihood: false
+    eta_lambda: 1e-12, eta_alpha: 5e-8, eta_gamma2: 5e-8, verify_likelihood: false, solver: 0
   },
   'rTV-MRF': { 
-    lambda: 1e-7, alpha: 0.05, sigma_sq: 100.0, max_iter: 50, is_learning: false
+    lambda: 1e-7, alpha: 0.05, sigma_sq: 100.0, max_iter: 50, is_learning: false, solver: 0, tv_solver: 0
   },
   'LC-MRF': { 
     lambda: 1e-7, alpha: 5e-3, sigma_sq: 10.0, s: 30.0, max_iter: 10, is_learning: true,
-    epsilon_map: 1.0, epsilon_pri: 1e-4, epsilon_post: 1e-4, 
+    epsilon_map: 1.0, map_optimizer: 0, epsilon_pri: 1e-4, epsilon_post: 1e-4, 
     eta_lambda: 1e-14, eta_alpha: 5e-8, eta_sigma2: 1.0,
-    n_pri: 5, n_post: 5, t_hat_max: 10, t_dot_max: 10
+    n_pri: 5, n_post: 5, t_hat_max: 10, t_dot_max: 10, persistent_chains: false, seed: 1, precision: 0
   }
 };
 
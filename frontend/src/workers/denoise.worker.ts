@@ -1,11 +1,41 @@
-import createModule from '../wasm/denoise_module.js';
-
 let wasmModule: any = null;
 let engine: any = null;
 let isAborted = false;
+let currentRun = 0; // 実行ごとの番号。新しい実行や再初期化で古いタイムスライスのループを止める
+let threaded = false; // pthread 版を読み込んだか (非同期の指標評価が使える)
+
+// 1 回の step で使う時間 (ミリ秒)。合間に abort などのメッセージを処理する
+const SLICE_MS = 16;
+const STEP_RUNNING = 0;
+
+// タイマーの最小遅延を受けずにイベントループへ制御を返す
+const yieldChannel = new MessageChannel();
+const yieldToEventLoop = () =>
+  new Promise<void>((resolve) => {
+    yieldChannel.port1.onmessage = () => resolve();
+    yieldChannel.port2.postMessage(null);
+  });
 
+// SIMD128 命令 (i8x16.splat / i8x16.popcnt) を 1 つだけ含む最小モジュール。検証に通れば SIMD 版を使える
+const SIMD_PROBE = new Uint8Array([
+  0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10, 10, 1, 8, 0, 65, 0, 253, 15, 253, 98, 11,
+]);
+
+// クロスオリジン分離 (COOP/COEP) されていれば SharedArrayBuffer が使えるので pthread 版を読み込む。
+// GitHub Pages などヘッダーを付けられない環境ではシングルスレッド版にフォールバックする。
+// どちらも SIMD 対応ブラウザでは SIMD128 版を選ぶ
 const initWasm = async () => {
   if (!wasmModule) {
+    const threads = (self as any).crossOriginIsolated === true;
+    threaded = threads;
+    const simd = WebAssembly.validate(SIMD_PROBE);
+    const { default: createModule } = threads
+      ? simd
+        ? await import('../wasm/denoise_module_mt_simd.js')
+        : await import('../wasm/denoise_module_mt.js')
+      : simd
+        ? await import('../wasm/denoise_module_simd.js')
+        : await import('../wasm/denoise_module.js');
     wasmModule = await createModule();
   }
 };
@@ -22,16 +52,24 @@ self.onmessage = async (e) => {
     if (type === 'init') {
       await initWasm();
       const { width, height } = data;
-      if (engine) engine.delete();
+      currentRun++;
+      if (engine) {
+        engine.cancel();
+        engine.delete();
+      }
       engine = new wasmModule.WasmEngine(width, height);
       self.postMessage({ type: 'initialized' });
     }
 
     if (type === 'run') {
+      const runId = ++currentRun;
       isAborted = false;
       const { algorithm, params, originalImage, noisyImage } = data;
       
-      engine.setInput(originalImage, noisyImage);
+      // 入力は WASM ヒープ上のバッファへ直接書き込む (ビューはメモリ拡張で無効になるので都度取得する)
+      engine.getOriginalInputView().set(originalImage);
+      engine.getNoisyInputView().set(noisyImage);
+      engine.commitInput();
 
       // 初期状態のヒートマップを即座に送信
       const initialHeatmapData = new Uint8Array(engine.getInitialSSIMHeatmap());
@@ -42,8 +80,15 @@ self.onmessage = async (e) => {
       let globalStep = 0; // X軸用の連続ステップ数
       const startTime = performance.now();
 
-      const onStep = (iter: number, energy: number, psnr: number, ssim: number, task: string) => {
-        if (isAborted) throw new Error('ABORTED');
+      // single モードでは報告ごとの SSIM ヒートマップも受け取る。pthread 版では指標とヒートマップの評価を
+      // 別スレッドに任せてソルバを先へ進める (その報告は step の合間にこのスレッドへ転送されて届く)
+      engine.setProgressPolicy({
+        every_k: 1, every_ms: 0, compute_metrics: true,
+        compute_heatmap: data.mode === 'single', async_metrics: threaded,
+      });
+
+      // heatmap はコールバック中だけ有効なヒープ上のビュー (計算していなければ null)
+      const onStep = (iter: number, energy: number, psnr: number, ssim: number, task: string, heatmap: Uint8Array | null) => {
         finalPsnr = psnr;
         finalSsim = ssim;
         globalStep++;
@@ -51,11 +96,14 @@ self.onmessage = async (e) => {
         if (data.mode === 'single') {
           const resultView = engine.getOutput();
           const resultCopy = new Uint8Array(resultView);
+          const heatmapCopy = heatmap ? new Uint8Array(heatmap) : null;
+          const transfer = heatmapCopy ? [resultCopy.buffer, heatmapCopy.buffer] : [resultCopy.buffer];
           self.postMessage({ 
             type: 'progress', 
             data: { iteration: iter, step: globalStep, energy, psnr, ssim, task },
-            image: resultCopy 
-          }, [resultCopy.buffer] as any);
+            image: resultCopy,
+            heatmap: heatmapCopy
+          }, transfer as any);
         } else {
           self.postMessage({ 
             type: 'progress', 
@@ -64,22 +112,25 @@ self.onmessage = async (e) => {
         }
       };
 
-      try {
-        if (algorithm === 'GMRF') {
-          engine.runGMRF(params, onStep);
-        } else if (algorithm === 'LC-MRF') {
-          engine.runLCMRF(params, onStep);
-        } else if (algorithm === 'HGMRF') {
-          engine.runHGMRF(params, onStep);
-        } else if (algorithm === 'rTV-MRF') {
-          engine.runRTVMRF(params, onStep);
-        }
-      } catch (e: any) {
-        if (e.message === 'ABORTED') {
+      if (algorithm === 'GMRF') {
+        engine.startGMRF(params, onStep);
+      } else if (algorithm === 'LC-MRF') {
+        engine.startLCMRF(params, onStep);
+      } else if (algorithm === 'HGMRF') {
+        engine.startHGMRF(params, onStep);
+      } else if (algorithm === 'rTV-MRF') {
+        engine.startRTVMRF(params, onStep);
+      }
+
+      // タイムスライスごとに進め、合間にメッセージを処理する。中断はソルバを破棄するだけで済む
+      while (engine.step(SLICE_MS) === STEP_RUNNING) {
+        await yieldToEventLoop();
+        if (runId !== currentRun) return; // 新しい実行や再初期化に置き換えられた
+        if (isAborted) {
+          engine.cancel();
           self.postMessage({ type: 'aborted' });
           return;
         }
-        throw e;
       }
 
       const endTime = performance.now();
@@ -27,5 +27,12 @@ export default defineConfig({
       'Cross-Origin-Opener-Policy': 'same-origin',
       'Cross-Origin-Embedder-Policy': 'require-corp',
     }
+  },
+  preview: {
+    // 🚀 ビルド成果物の確認時も pthread 版 WASM が動くようにクロスオリジン分離する
+    headers: {
+      'Cross-Origin-Opener-Policy': 'same-origin',
+      'Cross-Origin-Embedder-Policy': 'require-corp',
+    }
   }
 })